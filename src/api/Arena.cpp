@@ -0,0 +1,49 @@
+/* This file contains function definitions for the Arena class
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+// This constructor creates an empty arena, and the first block is allocated by the first allocation
+DB::Arena::Arena() : block_used(BLOCK_SIZE), allocations(0)
+{
+}
+
+/* This function returns the address of size bytes that stay valid until the arena is destroyed
+* Allocations larger than a block get a block of their own, and the current block is kept for later allocations
+*/
+char* DB::Arena::allocate(size_t size)
+{
+	allocations++;
+
+	if (size > BLOCK_SIZE)
+	{
+		std::unique_ptr<char[]> block(new char[size]);
+		char* data = block.get();
+		blocks.insert(blocks.empty() ? blocks.end() : blocks.end() - 1, std::move(block));
+		return data;
+	}
+
+	if (block_used + size > BLOCK_SIZE)
+	{
+		blocks.push_back(std::unique_ptr<char[]>(new char[BLOCK_SIZE]));
+		block_used = 0;
+	}
+
+	char* data = blocks.back().get() + block_used;
+	block_used += size;
+	return data;
+}
+
+// This getter returns the number of allocations made from the arena
+size_t DB::Arena::get_allocations()
+{
+	return allocations;
+}
+
+// This getter returns the number of blocks allocated by the arena
+size_t DB::Arena::get_blocks()
+{
+	return blocks.size();
+}
@@ -12,18 +12,22 @@ DB::AttrChar16::AttrChar16()
 }
 
 
-// This function writes Attr information to disk using a stream object
-void DB::AttrChar16::write(std::fstream& stream)
+/* This function writes Attr information to disk using a stream object
+* Version 1 files store the Attr name before the data
+*/
+void DB::AttrChar16::write(std::ostream& stream, unsigned int format)
 {	
 	/* Write out the Attr properties
 	*
 	*/
-	stream.write(name.get().c_str(), name.get_size());
+	if (format == FORMAT_V1)
+		stream.write(name.get().c_str(), name.get_size());
+
 	stream.write(data.get().c_str(), size);
 }
 
 // This function reads Attr information from disk using a stream object
-void DB::AttrChar16::read(std::fstream& stream)
+void DB::AttrChar16::read(std::istream& stream)
 {	
 	// Read the Attr properties from disk
 	data.read(stream);
@@ -17,16 +17,20 @@ DB::AttrID::AttrID()
 	size = sizeof(unsigned int);
 }
 
-// This function writes Attr information to disk using a stream object
-void DB::AttrID::write(std::fstream& stream)
+/* This function writes Attr information to disk using a stream object
+* Version 1 files store the Attr name before the data
+*/
+void DB::AttrID::write(std::ostream& stream, unsigned int format)
 {	
 	// Write out the Attr properties
-	stream.write(name.get().c_str(), name.get_size());
+	if (format == FORMAT_V1)
+		stream.write(name.get().c_str(), name.get_size());
+
 	stream.write(reinterpret_cast<const char*>(&data), size);
 }
 
 // This function reads Attr information from disk using a stream object
-void DB::AttrID::read(std::fstream& stream)
+void DB::AttrID::read(std::istream& stream)
 {	
 	// Read the Attr properties from disk
 	unsigned int data;
@@ -4,282 +4,558 @@
 */
 
 #include <DB.h>
+#include <cstdio>
+#include <cmath>
+
+/* This function returns the size of a fixed width string value without its padding spaces
+* Exports write names and character values without the padding they are stored with
+*/
+static size_t get_unpadded_size(const char* data, size_t size)
+{
+	while (size > 0 && data[size - 1] == ' ')
+		size--;
+
+	return size;
+}
+
+// This function appends the decimal digits of an integer, which is faster than formatting it with printf
+static void append_integer(std::string& buffer, long long value)
+{
+	char digits[24];
+	char* end = digits + sizeof(digits);
+	char* start = end;
+	unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long) value : (unsigned long long) value;
+
+	do
+	{
+		*--start = (char) ('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude != 0);
+
+	if (value < 0)
+		*--start = '-';
+
+	buffer.append(start, end - start);
+}
+
+// This function appends a string to a CSV row, quoting it if it contains a separator, quote or line break
+static void append_csv_string(std::string& buffer, const char* data, size_t size)
+{
+	bool quoted = false;
+	for (size_t i = 0; i < size && ! quoted; i++)
+		quoted = data[i] == ',' || data[i] == '"' || data[i] == '\n' || data[i] == '\r';
+
+	if (! quoted)
+	{
+		buffer.append(data, size);
+		return;
+	}
+
+	buffer += '"';
+	for (size_t i = 0; i < size; i++)
+	{
+		if (data[i] == '"')
+			buffer += '"';
+		buffer += data[i];
+	}
+	buffer += '"';
+}
+
+// This function appends a string to a JSON object as a quoted string, escaping quotes, backslashes and control characters
+static void append_json_string(std::string& buffer, const char* data, size_t size)
+{
+	buffer += '"';
+	for (size_t i = 0; i < size; i++)
+	{
+		unsigned char c = data[i];
+		if (c == '"' || c == '\\')
+		{
+			buffer += '\\';
+			buffer += (char) c;
+		}
+		else if (c < 0x20)
+		{
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+			buffer += escape;
+		}
+		else
+		{
+			buffer += (char) c;
+		}
+	}
+	buffer += '"';
+}
 
 // This constructor initializes metadata defaults when the database object is created
 DB::DB()
 {
 	is_loaded = false;
+	header_dirty = false;
+	header_state = HEADER_CLOSED;
+	layout = LAYOUT_ROWS;
+	group_rows = GROUP_ROWS;
+	generation = 0;
+	vectorized = true;
+	scan_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	shared = false;
+	session_shared = false;
+	search_file_count = 0;
+	change_offset = 0;
+	compaction_running = false;
+	compaction_replaced = false;
+	write_log = false;
+	log_unsynced = 0;
+	log_sequence = 0;
+	log_synced = 0;
+	commit_operations = 64;
+	commit_interval = 10;
+	log_stopping = false;
+	page_cache.set_capacity(db_file, CACHE_SIZE / PageCache::PAGE_SIZE);
+
+	// Inserts reuse the slots of removed records, so compaction only runs when requested by default
+	compaction_threshold = 2;
 }
 
-// This API function creates the database file given a new table
-void DB::create(std::string db_name, DB::Table table)
+/* This destructor flushes the header and closes the database file if it is still open
+* A background compaction and the log worker are finished first
+*/
+DB::~DB()
 {
-	// Open a stream with the database file
+	close();
+}
+
+/* This API function creates the database file given a new table
+* Records are stored in rows by default, or in row groups of contiguous field values for the columnar layout
+*/
+void DB::create(std::string db_name, DB::Table table, int layout)
+{
+	// Close any database this object already has open before switching files
+	wait_for_compaction();
+	stop_log();
+	WriteLock lock(*this);
+	close_file();
+
+	// Open a stream with the database file, discarding any existing contents
 	std::string db_filename = db_name + DB_EXT;
-	std::fstream db_file(db_filename.c_str(), std::fstream::out | std::ios::binary);
-	
+	db_file.open(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+
 	// Ensure we are at the beginning of the file to avoid any data corruption
-	if (db_file.tellg() != 0)
+	if (! db_file.is_open() || db_file.tellp() != 0)
 		return;
 	
-	// Write the table to the database file
+	/* Write the format version and the table to the database file
+	* and remember where the record header begins
+	*/
+	format_version = FORMAT_CURRENT;
+	write_format(db_file, format_version);
 	table.write(db_file);
+	table_offset = db_file.tellp();
+
+	this -> layout = layout == LAYOUT_COLUMNS ? LAYOUT_COLUMNS : LAYOUT_ROWS;
+	group_rows = GROUP_ROWS;
 	
-	// Initialize the record count and write it to file
+	/* Initialize the record count and id map and calculate the record size from an empty record
+	* so the header is complete before the first insert
+	*/
+	Record record;
+	record.set_table(table);
+	record.sanitize();
 	record_count = 0;
-	removed_count = 0;
-	db_file.write(reinterpret_cast<const char*>(&record_count), sizeof(unsigned int));
-		
-	db_file.close();
+	record_size = record.get_size(format_version);
+	next_id = 1;
+	id_slots.assign(1, 0);
+	free_slots.clear();
+	header_state = HEADER_OPEN;
+	write_header();
 	
 	// Set this database as loaded so record operations can be performed and store important DB metadata
 	this -> is_loaded = true;
 	this -> db_name = db_name;
 	this -> table = table;
+	build_layout();
+
+	// Remove any id map, log or index files left over from an older database with the same name
+	std::remove(get_ids_filename().c_str());
+	std::remove(get_log_filename().c_str());
+
+	const std::map<std::string, Field>& fields = table.get_fields();
+	std::map<std::string, Field>::const_iterator it;
+	for (it = fields.begin(); it != fields.end(); it++)
+		std::remove(get_index_filename(it -> second.get_name()).c_str());
+
+	// Other processes can share the new database once it is complete
+	if (shared)
+		open_session();
+
+	if (write_log)
+		open_log();
 }
 
 /* This API function loads the database table in to memory given the database name
+* The database file is kept open for record operations until close is called
 *
 * Argument: db_name
 */
 void DB::load(std::string db_name)
 {
+	// Close any database this object already has open before switching files
+	wait_for_compaction();
+	stop_log();
+	WriteLock lock(*this);
+	close_file();
 	
 	// Open a stream with the database file
 	std::string db_filename = db_name + DB_EXT;
-	std::fstream db_file(db_filename.c_str(), std::fstream::in | std::ios::binary);
+	open_file(db_filename);
 	
 	// Ensure we are at the beginning of the file to avoid any data corruption 
-	if (db_file.tellg() != 0)
+	if (! db_file.is_open() || db_file.tellg() != 0)
 		return;
 	
-	// Load the database table
+	/* Load the file format version and the database table
+	* and remember where the record header begins
+	*/
+	format_version = read_format(db_file);
+	table = Table();
 	table.read(db_file);
-	
-	// Load the database record count
-	db_file.read((char*)&record_count, sizeof(unsigned int));
-	unsigned int record_size;
-	db_file.read((char*)&record_size, sizeof(unsigned int));
+	table_offset = db_file.tellg();
+	this -> db_name = db_name;
 
-	// Read through the records to determine the removed count
-	removed_count = 0;
-	for (unsigned int i = 1; i <= record_count; i++)
+	/* Shared sessions lock the file before reading the header, and reopen it if another session just replaced it
+	* Only the first session to open the file repairs an open header, since the sessions that opened it may still be running
+	*/
+	bool first_session = true;
+	if (shared && format_version == FORMAT_CURRENT && open_session())
 	{
-		// Read in the record
-		Record temp_record;
-		temp_record.set_table(table);
-		temp_record.read(db_file);
+		while (file_lock.is_replaced())
+		{
+			db_file.close();
+			open_file(db_filename);
+			file_lock.open(db_filename);
+			file_lock.lock(true, true);
+		}
 
-		// Check for a matching value
-		if (temp_record.get_id() == 0)
-			removed_count++;
+		first_session = session_lock.lock(true, false);
+		session_lock.lock(false, true);
+
+		// Change journal entries left by sessions that have all closed describe ids the first session reads anyway
+		if (first_session)
+			change_file.truncate(0);
 	}
+	
+	/* Replay any write-ahead log left by a session that didn't close, which leaves the file as it was after its last logged operation
+	* Logged sessions write the header with every operation, so the header is then trusted even though it is still open
+	*/
+	bool logged = first_session && replay_log();
+
+	// A temporary file left by a compaction or upgrade that didn't finish is never used, so it is removed
+	if (first_session)
+		std::remove((db_filename + TEMP_EXT).c_str());
+
+	// Load the database record header
+	unsigned int removed = 0;
+	bool header_closed = read_header(removed, ! first_session || logged);
 
 	// Set this database as loaded so record operations can be performed and store important DB metadata
 	this -> is_loaded = true;
-	this -> db_name = db_name;
-	
+	build_layout();
+
+	/* If the header wasn't closed cleanly, verify the records against it and repair it
+	* The record count is taken from the file size in whole records or row groups, and the id map is rebuilt from the records
+	*/
+	if (! header_closed)
+	{
+		db_file.seekg(0, std::ios::end);
+		std::streamoff records_size = db_file.tellg() - get_records_offset();
+		if (records_size < 0)
+			records_size = 0;
+
+		record_count = records_size / record_size;
+		if (layout == LAYOUT_COLUMNS)
+			record_count -= record_count % group_rows;
+		rebuild_ids(next_id);
+		header_dirty = true;
+	}
+
+	/* Otherwise load the id map saved when the database was last closed, or read through the records to rebuild it
+	* Sessions that aren't the first to open a shared file always rebuild it, since the saved map may be out of date
+	*/
+	else if (! first_session || ! read_ids() || (format_version >= FORMAT_V3 && free_slots.size() != removed))
+	{
+		rebuild_ids(next_id);
+	}
+
+	change_offset = change_file.get_size();
+
+	if (write_log)
+		open_log();
+
+	// Mark a version 3 header as open until the database is closed
+	if (format_version >= FORMAT_V3)
+	{
+		header_state = HEADER_OPEN;
+		write_header();
+		flush_file();
+	}
+
+	/* Index side files are written outside the write-ahead log and in no order with the database file,
+	* so after a session that didn't close or a log replay they may not match the records, and are rebuilt from them
+	*/
+	open_indexes();
+	if (! header_closed || logged)
+	{
+		std::map<std::string, Index>::iterator it;
+		for (it = indexes.begin(); it != indexes.end(); it++)
+			build_index(FixedString8(it -> first));
+	}
+}
+
+/* This API function closes the database file
+* Any background compaction is finished and any header information cached during record operations is written out first
+* The write-ahead log is checkpointed and removed before the header is marked closed
+*/
+void DB::close()
+{
+	wait_for_compaction();
+	stop_log();
+	WriteLock lock(*this);
+	close_file();
+}
+
+// This function closes the database file, the caller must hold the database mutex
+void DB::close_file()
+{
+	if (! db_file.is_open())
+		return;
+
+	/* Write out the id map, then the header
+	* A version 3 header is always written so it is marked closed after everything else is on disk
+	* Sessions sharing the file leave both to the last session to close it
+	*/
+	bool last_session = true;
+	if (session_shared)
+	{
+		session_lock.unlock();
+		last_session = session_lock.lock(true, false);
+	}
+
+	close_log(last_session);
+
+	if (last_session)
+	{
+		write_ids();
+		change_file.truncate(0);
+	}
+
+	if (format_version >= FORMAT_V3 && last_session)
+		header_state = HEADER_CLOSED;
+
+	if (header_dirty || (format_version >= FORMAT_V3 && last_session))
+		write_header();
+
+	flush_file();
 	db_file.close();
+	page_cache.clear();
+	indexes.clear();
+	is_loaded = false;
+
+	file_lock.close();
+	session_lock.close();
+	search_file_lock.close();
+	change_file.close();
+	change_entries.clear();
+	session_shared = false;
+
+	// Hash indexes stay enabled but are rebuilt on the next search after a load
+	std::map<std::string, HashIndex>::iterator it;
+	for (it = hash_indexes.begin(); it != hash_indexes.end(); it++)
+		it -> second.clear();
 }
 
 // This API function inserts a new record in the database
 void DB::insert(DB::Record record)
 {
-	// Open a stream with the database file
-	std::string db_filename = db_name + DB_EXT;
-	std::fstream db_file(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	WriteLock lock(*this);
 
-	// Ensure we are at the beginning of the file to avoid any data corruption
-	if (db_file.tellp() != 0)
+	if (! db_file.is_open())
 		return;
 
-	// Read in the field size and number of fields from disk
-	int num_fields;
-	unsigned int field_size;
-	db_file.read((char*)&num_fields, sizeof(int));
-	db_file.read((char*)&field_size, sizeof(unsigned int));
-
 	// Sanitize the record before writing any information to the database
 	record.sanitize();
 
-	/* Calculate where to overwrite the record count calculating the table size
-	* As well as the size of the record metadata
-	* Increment the record count and overwrite the existing count
-	*/
-	int table_offset = sizeof(int) + sizeof(unsigned int) + (field_size * num_fields);
-	db_file.seekp(table_offset);
-
-	record_count++;
-	record.set_id(record_count);
-	int record_size;
-	record_size = record.get_size();
-	db_file.write(reinterpret_cast<const char*>(&record_count), sizeof(unsigned int));
-	db_file.write(reinterpret_cast<const char*>(&record_size), sizeof(int));
-
-	/* Reopen the file at the end to append the new record
-	* Write the record information
-	*/
-	db_file.close();
-	db_file.open(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::ate | std::ios::binary);
-	record.write(db_file);
-	
-	db_file.close();
+	// Assign the next id and store the new record in a free slot or after the last record in the file
+	record.set_id(next_id);
+
+	std::ostringstream buffer;
+	record.write(buffer, format_version);
+	store_records(buffer.str(), 1);
+}
 
+// This API function inserts a vector of records in the database
+void DB::insert_batch(const std::vector<DB::Record>& records)
+{
+	insert_batch(records.begin(), records.end());
 }
 
 // This API function updates a record in the database
 void DB::update(DB::Record record)
 {
-	// If the provided record doesn't have a valid id, don't perform any update operations
-	if (record.get_id() == 0)
-		return;
+	WriteLock lock(*this);
 
-	if (record.get_id() > record_count)
+	if (! db_file.is_open())
 		return;
-	
-	// Open a stream with the database file
-	std::string db_filename = db_name + DB_EXT;
-	std::fstream db_file(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
 
-	// Ensure we are at the beginning of the file to avoid any data corruption
-	if (db_file.tellp() != 0)
+	// If the provided record doesn't have the id of a stored record, don't perform any update operations
+	unsigned int slot = get_slot(record.get_id());
+	if (slot == 0)
 		return;
 
-	// Read in the field size and number of fields from disk
-	int num_fields;
-	unsigned int field_size;
-	db_file.read((char*)&num_fields, sizeof(int));
-	db_file.read((char*)&field_size, sizeof(unsigned int));
-
 	// Sanitize the record before writing any information to the database
 	record.sanitize();
 
-	// Calculate where to overwrite the existing record
-	int table_offset = sizeof(int) + sizeof(unsigned int) + (field_size * num_fields);
-	int record_offset = table_offset + sizeof(unsigned int) + sizeof(int) + (record.get_size() * (record.get_id() - 1));
-	db_file.seekp(record_offset);
+	// Read the existing record so its old values can be removed from any indexes
+	std::string old_record(record_size, '\0');
+	if (! indexes.empty() || ! hash_indexes.empty())
+		read_slot(slot, &old_record[0]);
 
 	// Overwrite the existing record with the new information
-	record.write(db_file);
-	
-	db_file.close();
+	std::ostringstream buffer;
+	record.write(buffer, format_version);
+	std::string new_record = buffer.str();
+	write_slots(db_file, get_records_offset(), slot, new_record.data(), 1);
+	header_dirty = true;
+	mark_slot_changed(slot, record.get_id(), record.get_id());
 
+	if (! indexes.empty() || ! hash_indexes.empty())
+	{
+		update_indexes(old_record.data(), false);
+		update_indexes(new_record.data(), true);
+	}
 }
 
-/* This function allows the user to search the database for a record
-* based on the value in a particular integer field
+/* This API function inserts a flat record in the database
+* The record values are written as they are, with the next id, so nothing is serialized for current format databases
+* Records built on a schema that doesn't match the database table aren't inserted
 */
-std::vector<DB::Record> DB::search_int(std::string name, int value)
+void DB::insert(const DB::FlatRecord& record)
 {
-	// Create a vector of records to return
-	std::vector<Record> records;
-	
-	// If the provided field isn't in the list of int fields, don't search
-	std::map<std::string, Field> fields = table.get_fields();
-	FixedString8 fixed_name(name);
-	if (fields[fixed_name.get()].get_type() != ATTR_INT)
-		return records;
+	WriteLock lock(*this);
 
-	// Open a stream with the database file
-	std::string db_filename = db_name + DB_EXT;
-	std::fstream db_file(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	if (! db_file.is_open())
+		return;
 
-	// Ensure we are at the beginning of the file to avoid any data corruption
-	if (db_file.tellp() != 0)
-		return records;
-	
-	// Read in the field size and number of fields from disk
-	int num_fields;
-	unsigned int field_size;
-	db_file.read((char*)&num_fields, sizeof(int));
-	db_file.read((char*)&field_size, sizeof(unsigned int));
+	std::string buffer;
+	if (write_flat_record(buffer, record, next_id))
+		store_records(buffer, 1);
+}
 
+// This API function inserts a vector of flat records in the database with one write, like insert_batch for records
+void DB::insert_batch(const std::vector<DB::FlatRecord>& records)
+{
+	WriteLock lock(*this);
 
-	/* Calculate where to start the record search by using the table offset and
-	* retrieving the number of records
-	*/
-	int table_offset = sizeof(int) + sizeof(unsigned int) + (field_size * num_fields);
-	db_file.seekp(table_offset);
-	
-	unsigned int record_count;
-	int record_size;
-	db_file.read((char*)&record_count, sizeof(unsigned int));
-	db_file.read((char*)&field_size, sizeof(int));
-	
-	/* Search records by reading in records one by one (linear search)
-	* and checking if the value in the desired field matches the desired value
-	*/
-	for (unsigned int i = 1; i <= record_count; i++)
-	{
-		// Read in the record
-		Record temp_record;
-		temp_record.set_table(table);
-		temp_record.read(db_file);
+	if (! db_file.is_open())
+		return;
 
-		// Check for a matching value
-		if (temp_record.get_int(fixed_name.get()) == value && temp_record.get_id() != 0)
-			records.push_back(temp_record);
+	std::string buffer;
+	buffer.reserve(records.size() * record_size);
+
+	unsigned int count = 0;
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (write_flat_record(buffer, records[i], next_id + count))
+			count++;
 	}
-	
-	return records;
+
+	store_records(buffer, count);
 }
 
-/* This function allows the user to search the database for a record
-* based on the value in a particular floating point field
-*/
-std::vector<DB::Record> DB::search_float(std::string name, float value)
+// This API function updates a record in the database from a flat record with the id of the record
+void DB::update(const DB::FlatRecord& record)
 {
-	// Create a vector of records to return
-	std::vector<Record> records;
-	
-	// If the provided field isn't in the list of float fields, don't search
-	std::map<std::string, Field> fields = table.get_fields();
-	FixedString8 fixed_name(name);
-	if (fields[fixed_name.get()].get_type() != ATTR_FLOAT)
-		return records;
+	WriteLock lock(*this);
 
-	// Open a stream with the database file
-	std::string db_filename = db_name + DB_EXT;
-	std::fstream db_file(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	if (! db_file.is_open())
+		return;
 
-	// Ensure we are at the beginning of the file to avoid any data corruption
-	if (db_file.tellp() != 0)
-		return records;
-	
-	// Read in the field size and number of fields from disk
-	int num_fields;
-	unsigned int field_size;
-	db_file.read((char*)&num_fields, sizeof(int));
-	db_file.read((char*)&field_size, sizeof(unsigned int));
+	// If the provided record doesn't have the id of a stored record, don't perform any update operations
+	unsigned int id;
+	memcpy(&id, record.get_values().data(), sizeof(unsigned int));
+	unsigned int slot = get_slot(id);
+	std::string new_record;
+	if (slot == 0 || ! write_flat_record(new_record, record, id))
+		return;
 
+	// Read the existing record so its old values can be removed from any indexes
+	std::string old_record(record_size, '\0');
+	if (! indexes.empty() || ! hash_indexes.empty())
+		read_slot(slot, &old_record[0]);
 
-	/* Calculate where to start the record search by using the table offset and
-	* retrieving the number of records
-	*/
-	int table_offset = sizeof(int) + sizeof(unsigned int) + (field_size * num_fields);
-	db_file.seekp(table_offset);
-	
-	unsigned int record_count;
-	int record_size;
-	db_file.read((char*)&record_count, sizeof(unsigned int));
-	db_file.read((char*)&field_size, sizeof(int));
-	
-	/* Search records by reading in records one by one (linear search)
-	* and checking if the value in the desired field matches the desired value
-	*/
-	for (unsigned int i = 1; i <= record_count; i++)
+	write_slots(db_file, get_records_offset(), slot, new_record.data(), 1);
+	header_dirty = true;
+	mark_slot_changed(slot, id, id);
+
+	if (! indexes.empty() || ! hash_indexes.empty())
 	{
-		// Read in the record
-		Record temp_record;
-		temp_record.set_table(table);
-		temp_record.read(db_file);
+		update_indexes(old_record.data(), false);
+		update_indexes(new_record.data(), true);
+	}
+}
+
+// This API function returns the compiled schema of the loaded database table, for building flat records
+std::shared_ptr<const DB::Schema> DB::get_schema()
+{
+	std::shared_lock<std::shared_timed_mutex> lock(db_mutex);
+	return schema;
+}
+
+/* This function appends the serialized values of a flat record with an id to a buffer
+* Current format databases store records in the flat layout, so the values are copied as they are,
+* while version 1 records are converted to a Record and serialized
+* Returns false without changing the buffer if the record schema doesn't match the database table
+*/
+bool DB::write_flat_record(std::string& buffer, const DB::FlatRecord& record, unsigned int id)
+{
+	std::shared_ptr<const Schema> record_schema = record.get_schema();
+	if (! schema || (record_schema != schema && ! record_schema -> matches(*schema)))
+		return false;
 
-		// Check for a matching value
-		if (temp_record.get_float(fixed_name.get()) == value && temp_record.get_id() != 0)
-			records.push_back(temp_record);
+	if (format_version == FORMAT_V1)
+	{
+		Record temp_record = record.get_record();
+		temp_record.set_id(id);
+
+		std::ostringstream record_stream;
+		temp_record.write(record_stream, format_version);
+		buffer.append(record_stream.str());
+		return true;
 	}
-	
-	return records;
+
+	size_t start = buffer.size();
+	buffer.append(record.get_values());
+	memcpy(&buffer[start + schema -> get_fields()[0].get_offset()], &id, sizeof(unsigned int));
+	return true;
+}
+
+/* This function allows the user to search the database for a record
+* based on the value in a particular integer field
+*/
+std::vector<DB::Record> DB::search_int(std::string name, int value)
+{
+	Predicate predicate;
+	predicate.set_int(name, OP_EQ, value);
+	return scan(predicate);
+}
+
+/* This function allows the user to search the database for a record
+* based on the value in a particular floating point field
+*/
+std::vector<DB::Record> DB::search_float(std::string name, float value)
+{
+	Predicate predicate;
+	predicate.set_float(name, OP_EQ, value);
+	return scan(predicate);
 }
 
 /* This function allows the user to search the database for a record
@@ -287,173 +563,2349 @@ std::vector<DB::Record> DB::search_float(std::string name, float value)
 */
 std::vector<DB::Record> DB::search_char16(std::string name, std::string value)
 {
-	// Create a vector of records to return
-	std::vector<Record> records;
-	
-	// If the provided field isn't in the list of char16 fields, don't search
-	std::map<std::string, Field> fields = table.get_fields();
-	FixedString8 fixed_name(name);
-	if (fields[fixed_name.get()].get_type() != ATTR_CHAR16)
-		return records;
+	Predicate predicate;
+	predicate.set_char16(name, OP_EQ, value);
+	return scan(predicate);
+}
 
-	// Open a stream with the database file
-	std::string db_filename = db_name + DB_EXT;
-	std::fstream db_file(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+// These functions search for records matching a value in a field given by a handle from the database schema
+std::vector<DB::Record> DB::search_int(const DB::FieldHandle& field, int value)
+{
+	Predicate predicate;
+	predicate.set_int(field, OP_EQ, value);
+	return scan(predicate);
+}
 
-	// Ensure we are at the beginning of the file to avoid any data corruption
-	if (db_file.tellp() != 0)
-		return records;
-	
-	// Read in the field size and number of fields from disk
-	int num_fields;
-	unsigned int field_size;
-	db_file.read((char*)&num_fields, sizeof(int));
-	db_file.read((char*)&field_size, sizeof(unsigned int));
+std::vector<DB::Record> DB::search_float(const DB::FieldHandle& field, float value)
+{
+	Predicate predicate;
+	predicate.set_float(field, OP_EQ, value);
+	return scan(predicate);
+}
 
+std::vector<DB::Record> DB::search_char16(const DB::FieldHandle& field, std::string value)
+{
+	Predicate predicate;
+	predicate.set_char16(field, OP_EQ, value);
+	return scan(predicate);
+}
 
-	/* Calculate where to start the record search by using the table offset and
-	* retrieving the number of records
-	*/
-	int table_offset = sizeof(int) + sizeof(unsigned int) + (field_size * num_fields);
-	db_file.seekp(table_offset);
-	
-	unsigned int record_count;
-	int record_size;
-	db_file.read((char*)&record_count, sizeof(unsigned int));
-	db_file.read((char*)&field_size, sizeof(int));
-	
-	/* Search records by reading in records one by one (linear search)
-	* and checking if the value in the desired field matches the desired value
-	*/
-	for (unsigned int i = 1; i <= record_count; i++)
-	{
-		// Read in the record
-		Record temp_record;
-		temp_record.set_table(table);
-		temp_record.read(db_file);
-		AttrChar16 temp_value;
-		temp_value.set_data(value);
-		
-		// Check for a matching value
-		if (temp_record.get_char16(fixed_name.get()) == value && temp_record.get_id() != 0)
-			records.push_back(temp_record);
-	}
-	
-	return records;
+/* This function allows the user to search the database for records
+* matching a comparison or range predicate on any field
+*/
+std::vector<DB::Record> DB::search(DB::Predicate predicate)
+{
+	return scan(predicate);
 }
 
-// This method deletes a record in the database by id
-void DB::remove(unsigned int id)
-{	
-	// If the provided id isn't within a valid range, return
-	if (id > record_count || id <= 0)
-		return;
-	
-	// Open a stream with the database file and the temporary file
-	std::string db_filename = db_name + DB_EXT;
-	std::string db_filename_temp = db_name + DB_EXT + TEMP_EXT;
-	std::fstream db_file(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
-	std::fstream db_file_temp(db_filename_temp.c_str(), std::ios::out | std::ios::binary);
+/* This function streams the records matching a predicate to a visitor one at a time, in file order
+* The visitor reads each record through a view of the file and returns false to stop the search early,
+* and a limit other than 0 stops the search after that many records. Returns the number of records visited
+* Nothing is collected, so memory use doesn't grow with the number of matches
+* The database is locked for searching while the visitor runs, so it must not change the database
+*/
+unsigned int DB::search(DB::Predicate predicate, std::function<bool(RecordView&)> visitor, unsigned int limit)
+{
+	unsigned int count = 0;
+	scan(predicate, 1, [](unsigned int) {}, [&](unsigned int, RecordView& record)
+	{
+		count++;
+		return visitor(record) && (limit == 0 || count < limit);
+	});
 
-	// Ensure we are at the beginning of the file to avoid any data corruption
-	if (db_file.tellp() != 0)
-		return;
-	
-	// Read in the field size and number of fields from disk
-	int num_fields;
-	unsigned int field_size;
-	db_file.read((char*)&num_fields, sizeof(int));
-	db_file.read((char*)&field_size, sizeof(unsigned int));
+	return count;
+}
 
+/* This function searches for the records matching a predicate and returns only the selected fields of each record
+* The record id is always included, and names that aren't fields of the table are ignored
+* Only the selected values are copied out of the file, in to buffers allocated from an arena per scan chunk,
+* and the arenas are freed in one go with the last row of the search
+*/
+std::vector<DB::Row> DB::search(DB::Predicate predicate, const std::vector<std::string>& fields)
+{
+	std::shared_ptr<const RowLayout> row_layout;
+	unsigned int row_size = 0;
+	std::vector<std::shared_ptr<Arena> > chunk_arenas;
+	std::vector<std::vector<Row> > chunk_rows;
+	scan(predicate, scan_threads, [&](unsigned int chunk_count)
+	{
+		row_layout = build_row_layout(fields, row_size);
+		chunk_arenas.resize(chunk_count);
+		chunk_rows.resize(chunk_count);
+	},
+	[&](unsigned int chunk, RecordView& record)
+	{
+		if (! chunk_arenas[chunk])
+			chunk_arenas[chunk] = std::make_shared<Arena>();
 
-	/* Calculate where to start the record reading by using the table offset and
-	* retrieving the number of records
-	*/
-	int table_offset = sizeof(int) + sizeof(unsigned int) + (field_size * num_fields);
-	db_file.seekp(table_offset);
-	
-	unsigned int record_count;
-	int record_size;
-	db_file.read((char*)&record_count, sizeof(unsigned int));
-	db_file.read((char*)&record_size, sizeof(int));
-
-	// Calculate an offset to the record so it can be marked as removed
-	Record temp_record;
-	temp_record.set_table(table);
-	int record_offset = table_offset + sizeof(unsigned int) + sizeof(int) + (record_size * (id - 1));
-	db_file.seekp(record_offset);
-
-	/* Retrieve the record, mark the record as removed, and rewrite it
-	* If the record is already marked as removed, return
-	*/
-	temp_record.read(db_file);
+		chunk_rows[chunk].push_back(Row(row_layout, chunk_arenas[chunk], row_size, record));
+		return true;
+	});
 
-	if (temp_record.get_id() == 0)
-		return;
+	return join_chunks(chunk_rows);
+}
 
-	temp_record.set_id(0);
-	db_file.seekp(record_offset);
-	temp_record.write(db_file);
+// This function exports every live record of the database, see the export function with a predicate
+unsigned int DB::export_records(std::ostream& stream, int format, const std::vector<std::string>& fields)
+{
+	Predicate predicate;
+	predicate.set_all();
+	return export_records(stream, format, predicate, fields);
+}
 
-	removed_count++;
+/* This function writes the live records matching a predicate to a stream in file order
+* CSV exports start with a row of field names, JSON Lines exports write one object per record,
+* and binary exports start with the name, type and size of each field followed by the packed values of each record
+* Only the selected fields are exported, after the record id, or every field if none are selected
+* Records are read in place from the mapped file and collected in a large buffer, which is written to the stream as it fills
+* The fields are resolved once the search holds the database lock, so a compaction or upgrade can't change
+* the layout between reading the field list and reading the records
+* Returns the number of records exported, and the export stops if the stream fails
+*/
+unsigned int DB::export_records(std::ostream& stream, int format, DB::Predicate predicate, const std::vector<std::string>& fields)
+{
+	std::vector<FieldHandle> export_fields;
+	std::string buffer;
+	buffer.reserve(EXPORT_BUFFER_SIZE * 2);
 
-	// Check to see if the removed count has reached the threshold for rewriting records
-	if (( (double) removed_count / (double) record_count) < (1 / (double) REMOVED_THRESHOLD_DENOM))
+	unsigned int count = 0;
+	scan(predicate, 1, [&](unsigned int)
 	{
-		db_file.close();
-		db_file_temp.close();
+		export_fields = get_export_fields(fields);
+		if (! export_fields.empty())
+			write_export_header(buffer, format, export_fields);
+	},
+	[&](unsigned int, RecordView& record)
+	{
+		if (export_fields.empty())
+			return false;
+
+		write_export_record(buffer, format, export_fields, record);
+		count++;
+
+		if (buffer.size() < EXPORT_BUFFER_SIZE)
+			return true;
+
+		stream.write(buffer.data(), buffer.size());
+		buffer.clear();
+		return stream.good();
+	});
+
+	stream.write(buffer.data(), buffer.size());
+	stream.flush();
+	return count;
+}
+
+/* This method deletes a record in the database by id
+* Records are marked as removed in place and their slot is added to the free list for reuse by inserts
+* If the removed ratio reaches the compaction threshold the remaining records are rewritten by a background compaction
+*/
+void DB::remove(unsigned int id)
+{	
+	WriteLock lock(*this);
+
+	if (! db_file.is_open())
 		return;
-	}
-	
-	/* Read existing records and rewrite to the temporary database
-	* Do not rewrite records marked as deleted
-	* Update the ids of records along the way to ensure there are no gaps
+
+	// If the provided id isn't the id of a stored record, return
+	unsigned int slot = get_slot(id);
+	if (slot == 0)
+		return;
+
+	// Read the record so it can be removed from any indexes
+	std::string record(record_size, '\0');
+	read_slot(slot, &record[0]);
+
+	// Mark the record as removed by overwriting its id with 0, and remove it from any indexes
+	unsigned int id_offset = field_offsets[FixedString8("id").get()];
+	unsigned int removed_id = 0;
+
+	write_file(db_file, get_records_offset() + get_value_position(slot, id_offset, sizeof(unsigned int)),
+		reinterpret_cast<const char*>(&removed_id), sizeof(unsigned int));
+	update_indexes(record.data(), false);
+
+	id_slots[id] = 0;
+	free_slots.push_back(slot);
+	header_dirty = true;
+	mark_slot_changed(slot, id, 0);
+
+	// Check to see if the removed count has reached the threshold for rewriting records
+	if (( (double) free_slots.size() / (double) record_count) >= compaction_threshold)
+		start_compaction();
+}
+
+/* This API function sets the ratio of removed records to total records that starts a background compaction
+* A threshold above 1 turns off automatic compaction, compact_now can still be used
+*/
+void DB::set_compaction_threshold(double threshold)
+{
+	WriteLock lock(*this);
+	compaction_threshold = threshold;
+}
+
+/* This API function sets a function that compaction calls after each step of replacing the database file
+* The step is one of the compaction steps, and the function runs on the compaction worker while it holds the database lock,
+* so it must not use the database. It is meant for tests that stop the process part way through a compaction
+*/
+void DB::set_compaction_hook(std::function<void(int step)> hook)
+{
+	WriteLock lock(*this);
+	compaction_hook = hook;
+}
+
+// This API function starts a background compaction of the database unless one is already running
+void DB::compact_now()
+{
+	WriteLock lock(*this);
+	start_compaction();
+}
+
+// This API function returns whether a background compaction is running
+int DB::compaction_status()
+{
+	if (compaction_running)
+		return COMPACTION_RUNNING;
+
+	return COMPACTION_IDLE;
+}
+
+/* This API function blocks until any background compaction has finished and replaced the database file
+* The worker never takes the thread mutex, and writers only take it once the worker is done with the database mutex,
+* so joining with it held can't deadlock
+*/
+void DB::wait_for_compaction()
+{
+	std::lock_guard<std::mutex> thread_lock(compaction_thread_mutex);
+	if (compaction_thread.joinable())
+		compaction_thread.join();
+}
+
+// This function calls the compaction hook, if one is set, after a step of replacing the database file
+void DB::report_compaction_step(int step)
+{
+	if (compaction_hook)
+		compaction_hook(step);
+}
+
+// This function starts the background compaction worker, the caller must hold the database mutex
+void DB::start_compaction()
+{
+	if (! db_file.is_open() || compaction_running)
+		return;
+
+	/* A worker that has already finished still has to be joined before it can be replaced
+	* The worker clears compaction_running under the database mutex as its last step, so this join doesn't wait on the mutex
+	*/
+	std::lock_guard<std::mutex> thread_lock(compaction_thread_mutex);
+	if (compaction_thread.joinable())
+		compaction_thread.join();
+
+	compaction_changed.assign(record_count + 1, false);
+	compaction_replaced = false;
+	compaction_running = true;
+	compaction_thread = std::thread(&DB::compact, this);
+}
+
+/* This function runs on the background compaction worker
+* Live records are copied to the temporary file with no free slots in between while record operations continue
+* Afterwards, with the database mutex held, slots written during the copy are copied again,
+* records appended during the copy are added, and the temporary file replaces the database file
+* Record ids don't change, only the id map is updated with the new slots
+*/
+void DB::compact()
+{
+	/* Take a copy of the layout information needed for the copy
+	* Buffered writes are flushed so the copy sees every record written so far in the file
+	*/
+	WriteLock lock(*this);
+	flush_file();
+	std::string db_filename = db_name + DB_EXT;
+	std::string db_filename_temp = db_name + DB_EXT + TEMP_EXT;
+	unsigned int count = compaction_changed.size() - 1;
+	unsigned int size = record_size;
+	unsigned int id_offset = field_offsets[FixedString8("id").get()];
+	std::streamoff first_offset = get_records_offset();
+
+	/* Open the temporary file and a separate read stream on the database file
 	* Start by writing the table data to the temporary file and a temporary record count and record size as a placeholder
 	* After the new record count has been determined it will be rewritten
 	*/
+	std::fstream db_file_temp(db_filename_temp.c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+	std::ifstream db_file_source(db_filename.c_str(), std::ios::binary);
+	if (! db_file_temp.is_open() || ! db_file_source.is_open())
+	{
+		compaction_changed.clear();
+		compaction_running = false;
+		return;
+	}
+
+	write_format(db_file_temp, format_version);
 	table.write(db_file_temp);
-	db_file_temp.write(reinterpret_cast<const char*>(&record_count), sizeof(unsigned int));
-	db_file_temp.write(reinterpret_cast<const char*>(&record_size), sizeof(int));
+	write_header(db_file_temp, format_version, count, size, 0);
+	lock.unlock();
+
+	/* Copy the records in chunks without holding the database mutex
+	* Records marked as removed are skipped, and the new slot of every copied slot and the id in every new slot are remembered
+	* Chunks hold whole row groups, so the slots of a chunk can be located from the start of the chunk
+	*/
+	std::vector<unsigned int> new_slots(count + 1, 0);
+	std::vector<unsigned int> slot_ids;
+	std::vector<char> chunk;
+	std::string output;
+	std::string record(size, '\0');
 
-	record_offset = table_offset + sizeof(unsigned int) + sizeof(int);
-	db_file.seekp(record_offset);
-	int shift = 0;
-	for (unsigned int i = 1; i < record_count + 1; i++)
+	db_file_source.seekg(first_offset);
+	for (unsigned int start = 1; start <= count; start += RECORD_CHUNK)
 	{
-		// Read in the record
-		Record temp_record;
-		temp_record.set_table(table);
-		temp_record.read(db_file);
-		unsigned int cur_id = temp_record.get_id();
+		unsigned int chunk_count = count - start + 1;
+		if (chunk_count > RECORD_CHUNK)
+			chunk_count = RECORD_CHUNK;
+
+		chunk.resize(get_records_size(chunk_count));
+		db_file_source.read(&chunk[0], chunk.size());
 
-		/* If the record is marked as removed, don't rewrite it
-		* Decrease the shift counter so subsequent records ids can be shifted
-		*/
-		if (cur_id == 0)
+		output.clear();
+		unsigned int output_slot = slot_ids.size() + 1;
+		for (unsigned int i = 0; i < chunk_count; i++)
 		{
-			shift--;
+			unsigned int stored_id;
+			memcpy(&stored_id, &chunk[get_value_position(i + 1, id_offset, sizeof(unsigned int))], sizeof(unsigned int));
+			if (stored_id == 0)
+				continue;
+
+			read_slot(&chunk[0], i + 1, &record[0]);
+			slot_ids.push_back(stored_id);
+			new_slots[start + i] = slot_ids.size();
+			output.append(record);
 		}
-		else
+
+		write_slots(db_file_temp, first_offset, output_slot, output.data(), slot_ids.size() - output_slot + 1);
+	}
+
+	db_file_source.close();
+
+	/* Catch up on the record operations made during the copy
+	* Changed slots are rewritten in their new place, or appended if they were copied as removed,
+	* and records appended during the copy are added after the copied records
+	*/
+	lock.lock();
+	flush_file();
+
+	// Drop the copy if another session sharing the file replaced it in the meantime
+	if (compaction_replaced)
+	{
+		db_file_temp.close();
+		std::remove(db_filename_temp.c_str());
+		compaction_changed.clear();
+		compaction_running = false;
+		return;
+	}
+
+	for (unsigned int slot = 1; slot <= record_count; slot++)
+	{
+		if (slot <= count && ! compaction_changed[slot])
+			continue;
+
+		read_slot(slot, &record[0]);
+
+		unsigned int stored_id;
+		memcpy(&stored_id, &record[id_offset], sizeof(unsigned int));
+
+		unsigned int new_slot = 0;
+		if (slot <= count)
+			new_slot = new_slots[slot];
+
+		if (new_slot == 0)
 		{
-			temp_record.set_id(cur_id + shift);
-			temp_record.write(db_file_temp);
+			if (stored_id == 0)
+				continue;
+
+			slot_ids.push_back(stored_id);
+			new_slot = slot_ids.size();
 		}
+
+		slot_ids[new_slot - 1] = stored_id;
+		write_slots(db_file_temp, first_offset, new_slot, record.data(), 1);
 	}
 
-	/* Update the record count and removed count
-	* Write the table and record info to the temporary file
+	/* Write the final record header to the temporary file
+	* The new file starts a new generation so sessions sharing the old file notice that it was replaced
 	*/
-	record_count += shift;
-	this -> record_count = record_count;
-	removed_count = 0;
-
+	unsigned int new_count = slot_ids.size();
+	pad_groups(db_file_temp, first_offset, new_count);
+	unsigned int new_removed = std::count(slot_ids.begin(), slot_ids.end(), 0u);
+	generation++;
 	db_file_temp.seekp(table_offset);
-	db_file_temp.write(reinterpret_cast<const char*>(&record_count), sizeof(unsigned int));
+	write_header(db_file_temp, format_version, new_count, size, new_removed);
+	db_file_temp.flush();
+	bool written = db_file_temp.good();
+	db_file_temp.close();
+
+	/* Finally, rename the temporary file over the main database file
+	* The temporary file is synced first and the rename replaces the database file in one step,
+	* so after a crash the database file holds either every old record or every compacted record
+	* The write-ahead log describes the old file, so it is checkpointed before the rename
+	* The change journal describes the old slots too, and other sessions read the new file from the start, so it is emptied
+	* while the old file is still locked, and its entries are put back if the file isn't replaced
+	* If the temporary file couldn't be written or renamed the database file is kept as it is
+	*/
+	if (written)
+	{
+		report_compaction_step(COMPACTION_WRITTEN);
+		sync_file(db_filename_temp);
+		report_compaction_step(COMPACTION_SYNCED);
+	}
+
+	if (log_file.is_open())
+		checkpoint_log();
+
+	std::string changes;
+	if (written && session_shared)
+	{
+		changes.resize(change_file.get_size());
+		if (! changes.empty() && change_file.read(0, &changes[0], changes.size()))
+			change_file.truncate(0);
+	}
 
+	flush_file();
 	db_file.close();
+	if (! written || ! LogFile::rename_file(db_filename_temp, db_filename))
+	{
+		if (change_file.get_size() == 0)
+			change_file.append(changes);
+
+		std::remove(db_filename_temp.c_str());
+		open_file(db_filename);
+		compaction_changed.clear();
+		compaction_running = false;
+		return;
+	}
+
+	report_compaction_step(COMPACTION_RENAMED);
+	LogFile::sync_directory(db_filename);
+	report_compaction_step(COMPACTION_DIRECTORY_SYNCED);
+
+	// The session stream and file lock are reopened on the new file
+	open_file(db_filename);
+	if (session_shared)
+		file_lock.open(db_filename);
+
+	change_offset = 0;
+
+	record_count = new_count;
+	header_dirty = false;
+
+	// Point the id map at the new slots, slots of records removed during the copy become free slots
+	id_slots.assign(next_id, 0);
+	free_slots.clear();
+	for (unsigned int slot = 1; slot <= new_count; slot++)
+	{
+		if (slot_ids[slot - 1] == 0)
+			free_slots.push_back(slot);
+		else
+			id_slots[slot_ids[slot - 1]] = slot;
+	}
+
+	compaction_changed.clear();
+	compaction_running = false;
+}
+
+/* This API function upgrades a loaded version 1 database to the current file format
+* The records are rewritten without Attr names to a temporary file which then replaces the database file
+* Record ids and removed records are preserved
+*/
+void DB::upgrade()
+{
+	wait_for_compaction();
+	WriteLock lock(*this);
+
+	if (! db_file.is_open() || format_version == FORMAT_CURRENT)
+		return;
+
+	// Open a stream with the temporary file
+	std::string db_filename = db_name + DB_EXT;
+	std::string db_filename_temp = db_name + DB_EXT + TEMP_EXT;
+	std::fstream db_file_temp(db_filename_temp.c_str(), std::ios::out | std::ios::binary);
+
+	// Write the new format version and the table, then calculate the new record size
+	write_format(db_file_temp, FORMAT_CURRENT);
+	table.write(db_file_temp);
+	std::streamoff new_table_offset = db_file_temp.tellp();
+
+	Record record;
+	record.set_table(table);
+	record.sanitize();
+	unsigned int new_record_size = record.get_size(FORMAT_CURRENT);
+
+	header_state = HEADER_OPEN;
+	write_header(db_file_temp, FORMAT_CURRENT, record_count, new_record_size, free_slots.size());
+
+	// Read each record in the old format and rewrite it in the new format
+	flush_file();
+	db_file.seekg(get_records_offset());
+	for (unsigned int i = 1; i <= record_count; i++)
+	{
+		Record temp_record;
+		temp_record.set_table(table);
+		temp_record.read(db_file, format_version);
+		temp_record.sanitize();
+		temp_record.write(db_file_temp, FORMAT_CURRENT);
+	}
+
+	db_file_temp.flush();
+	bool written = db_file_temp.good();
 	db_file_temp.close();
 
-	// Finally, rename the temporary file to replace the main database file
-	std::remove(db_filename.c_str());
-	std::rename(db_filename_temp.c_str(), db_filename.c_str());
+	/* Replace the database file and reopen the session stream with the new format information
+	* The temporary file is synced and renamed over the database file in one step like a compaction,
+	* and the write-ahead log describes the old file, so it is checkpointed before the rename
+	* If the temporary file couldn't be written or renamed the database file is kept in its old format
+	*/
+	if (written)
+		sync_file(db_filename_temp);
+
+	if (log_file.is_open())
+		checkpoint_log();
+
+	db_file.close();
+	if (! written || ! LogFile::replace(db_filename_temp, db_filename))
+	{
+		std::remove(db_filename_temp.c_str());
+		open_file(db_filename);
+		return;
+	}
+
+	header_dirty = false;
+	open_file(db_filename);
+
+	format_version = FORMAT_CURRENT;
+	table_offset = new_table_offset;
+	record_size = new_record_size;
+	build_layout();
+}
+
+/* This API function selects whether searches use vectorized scan kernels when the CPU supports them
+* Vectorized kernels are used by default, turning them off forces the scalar kernels
+*/
+void DB::set_vectorized(bool vectorized)
+{
+	WriteLock lock(*this);
+	this -> vectorized = vectorized;
+}
+
+/* This API function sets the number of threads that share a search that scans the records
+* By default, and when the number of threads is 0, one thread is used per CPU core
+*/
+void DB::set_scan_threads(unsigned int threads)
+{
+	WriteLock lock(*this);
+
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	scan_threads = threads;
+}
+
+/* This API function selects whether databases created or loaded after this call are shared with other processes
+* Shared databases lock the database file around every operation and write the record header after every change
+*/
+void DB::set_shared(bool shared)
+{
+	WriteLock lock(*this);
+	this -> shared = shared;
+}
+
+/* This API function selects whether databases created or loaded after this call keep a write-ahead log
+* Every operation is appended to the log before the database file is changed, so a crash can't leave it half done
+*/
+void DB::set_write_log(bool write_log)
+{
+	WriteLock lock(*this);
+	this -> write_log = write_log;
+}
+
+/* This API function sets how often the write-ahead log is synced to the disk
+* The log is synced once the given number of operations have been logged since the last sync, or every given number
+* of milliseconds while there are operations that haven't been synced. A time of 0 only syncs by the number of operations
+*/
+void DB::set_group_commit(unsigned int operations, unsigned int milliseconds)
+{
+	WriteLock lock(*this);
+	commit_operations = std::max(operations, 1u);
+	commit_interval = milliseconds;
+}
+
+/* This API function syncs the write-ahead log to the disk so every operation so far survives a crash
+* It only waits for other writers, so searches carry on while the log is synced
+*/
+void DB::commit()
+{
+	std::lock_guard<std::mutex> lock(write_mutex);
+
+	if (! log_file.is_open())
+		return;
+
+	log_unsynced = 0;
+	sync_log();
+}
+
+/* This API function sets the size of the page cache for the database file in bytes
+* Dirty pages are written back and the cache starts empty, and a size of 0 turns the cache off
+*/
+void DB::set_cache_size(size_t size)
+{
+	WriteLock lock(*this);
+	flush_file();
+	page_cache.set_capacity(db_file, size / PageCache::PAGE_SIZE);
+}
+
+// This API function returns the number of page cache accesses that found the page in the cache
+size_t DB::get_cache_hits()
+{
+	std::shared_lock<std::shared_timed_mutex> lock(db_mutex);
+	return page_cache.get_hits();
+}
+
+// This API function returns the number of page cache accesses that read the page from the database file
+size_t DB::get_cache_misses()
+{
+	std::shared_lock<std::shared_timed_mutex> lock(db_mutex);
+	return page_cache.get_misses();
+}
+
+/* This function lays out the values of the selected fields, with the record id first, for the rows of a projected search
+* The caller must hold the database mutex
+*/
+std::shared_ptr<const DB::RowLayout> DB::build_row_layout(const std::vector<std::string>& fields, unsigned int& row_size)
+{
+	std::vector<std::string> names(1, FixedString8("id").get());
+	for (size_t i = 0; i < fields.size(); i++)
+		names.push_back(FixedString8(fields[i]).get());
+
+	std::shared_ptr<RowLayout> row_layout(new RowLayout());
+	unsigned int offset = 0;
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (field_offsets.count(names[i]) == 0 || row_layout -> count(names[i]) > 0)
+			continue;
+
+		RowField& field = (*row_layout)[names[i]];
+		field.record_offset = field_offsets[names[i]];
+		field.offset = offset;
+		field.size = field_sizes[names[i]];
+		field.type = field_types[names[i]];
+		offset += field.size;
+	}
+
+	row_size = offset;
+	return row_layout;
+}
+
+/* This function finds the fields written by an export, starting with the record id
+* Names that aren't fields of the table are ignored, and selecting no names exports every field in record order
+* The schema is read directly, so the caller must hold the database lock
+*/
+std::vector<DB::FieldHandle> DB::get_export_fields(const std::vector<std::string>& fields)
+{
+	std::shared_ptr<const Schema> export_schema = schema;
+	if (! export_schema)
+		return std::vector<FieldHandle>();
+
+	if (fields.empty())
+		return export_schema -> get_fields();
+
+	std::vector<FieldHandle> export_fields(1, export_schema -> get_fields()[0]);
+	for (size_t i = 0; i < fields.size(); i++)
+	{
+		FieldHandle field = export_schema -> get_field(fields[i]);
+		bool selected = ! field.is_valid();
+		for (size_t j = 0; j < export_fields.size() && ! selected; j++)
+			selected = export_fields[j].get_name() == field.get_name();
+
+		if (! selected)
+			export_fields.push_back(field);
+	}
+
+	return export_fields;
+}
+
+/* This function writes the start of an export to the buffer
+* CSV exports start with the field names, and binary exports with the magic string, the field count,
+* and the 8 character name, type and size of each field
+*/
+void DB::write_export_header(std::string& buffer, int format, const std::vector<DB::FieldHandle>& fields)
+{
+	if (format == EXPORT_CSV)
+	{
+		for (size_t i = 0; i < fields.size(); i++)
+		{
+			if (i > 0)
+				buffer += ',';
+
+			const std::string& name = fields[i].get_name();
+			append_csv_string(buffer, name.data(), get_unpadded_size(name.data(), name.size()));
+		}
+		buffer += '\n';
+	}
+	else if (format == EXPORT_BINARY)
+	{
+		unsigned int count = fields.size();
+		buffer.append(EXPORT_MAGIC);
+		buffer.append(reinterpret_cast<const char*>(&count), sizeof(unsigned int));
+
+		for (size_t i = 0; i < fields.size(); i++)
+		{
+			int type = fields[i].get_type();
+			unsigned int size = fields[i].get_size();
+			buffer.append(fields[i].get_name());
+			buffer.append(reinterpret_cast<const char*>(&type), sizeof(int));
+			buffer.append(reinterpret_cast<const char*>(&size), sizeof(unsigned int));
+		}
+	}
+}
+
+/* This function writes the exported fields of a record to the buffer
+* CSV and JSON values are formatted as text, with character values unpadded and floats written with enough digits to read back exactly
+* Binary values are copied as they are stored
+*/
+void DB::write_export_record(std::string& buffer, int format, const std::vector<DB::FieldHandle>& fields, DB::RecordView& record)
+{
+	if (format == EXPORT_JSON)
+		buffer += '{';
+
+	for (size_t i = 0; i < fields.size(); i++)
+	{
+		const FieldHandle& field = fields[i];
+		const char* value = record.get_value(field, field.get_type());
+
+		if (format == EXPORT_BINARY)
+		{
+			if (value != NULL)
+				buffer.append(value, field.get_size());
+			else
+				buffer.append(field.get_size(), '\0');
+			continue;
+		}
+
+		if (i > 0)
+			buffer += ',';
+
+		if (format == EXPORT_JSON)
+		{
+			const std::string& name = field.get_name();
+			append_json_string(buffer, name.data(), get_unpadded_size(name.data(), name.size()));
+			buffer += ':';
+		}
+
+		if (value == NULL)
+		{
+			if (format == EXPORT_JSON)
+				buffer += "null";
+			continue;
+		}
+
+		int type = field.get_type();
+		if (type == ATTR_ID)
+		{
+			unsigned int data;
+			memcpy(&data, value, sizeof(unsigned int));
+			append_integer(buffer, data);
+		}
+		else if (type == ATTR_INT)
+		{
+			int data;
+			memcpy(&data, value, sizeof(int));
+			append_integer(buffer, data);
+		}
+		else if (type == ATTR_FLOAT)
+		{
+			float data;
+			memcpy(&data, value, sizeof(float));
+			if (format == EXPORT_JSON && ! std::isfinite(data))
+			{
+				buffer += "null";
+			}
+			// Whole numbers that floats hold exactly are written as integers, which is much faster than printf
+			else if (std::fabs(data) < 16777216.0f && data == (float) (int) data && ! (data == 0 && std::signbit(data)))
+			{
+				append_integer(buffer, (int) data);
+			}
+			else
+			{
+				char text[32];
+				buffer.append(text, snprintf(text, sizeof(text), "%.9g", data));
+			}
+		}
+		else if (format == EXPORT_JSON)
+		{
+			append_json_string(buffer, value, get_unpadded_size(value, field.get_size()));
+		}
+		else
+		{
+			append_csv_string(buffer, value, get_unpadded_size(value, field.get_size()));
+		}
+	}
+
+	if (format == EXPORT_JSON)
+		buffer += '}';
+
+	if (format != EXPORT_BINARY)
+		buffer += '\n';
+}
+
+/* This function scans every record for a field value matching the predicate and returns the matching records
+* Each scan thread reads the records matched in its chunks in to Record objects, and the chunks are joined in order
+* by moving the records, so their fields aren't copied again
+*/
+std::vector<DB::Record> DB::scan(DB::Predicate predicate)
+{
+	std::vector<std::vector<Record> > chunk_records;
+	scan(predicate, scan_threads, [&](unsigned int chunk_count)
+	{
+		chunk_records.resize(chunk_count);
+	},
+	[&](unsigned int chunk, RecordView& record)
+	{
+		chunk_records[chunk].push_back(record.get_record());
+		return true;
+	});
+
+	return join_chunks(chunk_records);
+}
+
+/* This function scans every record for a field value matching the predicate and passes the matches to a visitor
+* The database file is mapped in to memory and the field is compared in place at its
+* precomputed offset in each record, so only matching records are visited
+* Large scans are shared between up to the given number of threads
+*/
+void DB::scan(DB::Predicate predicate, unsigned int threads, const ScanStart& start, const ScanVisitor& visitor)
+{
+	std::unique_lock<std::mutex> gate(lock_gate);
+	std::shared_lock<std::shared_timed_mutex> lock(db_mutex);
+	gate.unlock();
+
+	/* Shared sessions catch up with changes made by other sessions before searching, which needs the lock exclusively
+	* If a writer holds the file lock, the search waits for it on a handle of its own without the database lock and tries again
+	*/
+	SearchLock session_search(*this);
+	bool stale = false;
+	while (session_shared && ! session_search.lock(stale))
+	{
+		lock.unlock();
+		if (stale)
+		{
+			WriteLock write_lock(*this);
+		}
+		else
+		{
+			FileLock wait_lock;
+			if (wait_lock.open(db_name + DB_EXT))
+				wait_lock.lock(false, true);
+		}
+
+		gate.lock();
+		lock.lock();
+		gate.unlock();
+	}
+
+	// If the provided field isn't in the table with the requested type, don't search
+	ScanField field;
+	if (! resolve_scan_field(predicate, field))
+	{
+		start(0);
+		return;
+	}
+
+	int type = field.type;
+	unsigned int id_offset = field.id_offset;
+	unsigned int value_offset = field.offset;
+	unsigned int value_size = field.size;
+
+	if (! db_file.is_open() || record_count == 0)
+	{
+		start(0);
+		return;
+	}
+
+	// Make sure any buffered writes are in the file before mapping it
+	std::unique_lock<std::mutex> search_lock(search_mutex);
+	flush_file();
+	search_lock.unlock();
+
+	std::string db_filename = db_name + DB_EXT;
+	MappedFile mapped_file;
+	if (! mapped_file.map(db_filename, get_records_offset() + get_records_size(record_count)))
+	{
+		start(0);
+		return;
+	}
+
+	const char* mapped_records = mapped_file.get_data() + get_records_offset();
+
+	// Retrieve the predicate bounds for the field type
+	int int_low = predicate.get_int_low();
+	int int_high = predicate.get_int_high();
+	float float_low = predicate.get_float_low();
+	float float_high = predicate.get_float_high();
+	std::string char16_low = predicate.get_char16_low();
+	std::string char16_high = predicate.get_char16_high();
+
+	const char* low = char16_low.c_str();
+	const char* high = char16_high.c_str();
+	if (type == ATTR_INT || type == ATTR_ID)
+	{
+		low = reinterpret_cast<const char*>(&int_low);
+		high = reinterpret_cast<const char*>(&int_high);
+	}
+	else if (type == ATTR_FLOAT)
+	{
+		low = reinterpret_cast<const char*>(&float_low);
+		high = reinterpret_cast<const char*>(&float_high);
+	}
+
+	/* If the field has a hash index or a B+-tree index, look up the matching ids instead of scanning every record
+	* Hash indexes are only used for equality, and are built from the mapped records the first time they are needed
+	* The ids are mapped to their slots and sorted so records are returned in file order like a scan
+	*/
+	bool equality = memcmp(low, high, type == ATTR_CHAR16 ? AttrChar16().get_size() : sizeof(int)) == 0;
+	bool use_hash_index = equality && ! hash_indexes.empty() && hash_indexes.count(field.name) > 0;
+
+	if (use_hash_index || (! indexes.empty() && indexes.count(field.name) > 0))
+	{
+		std::vector<unsigned int> ids;
+		search_lock.lock();
+		if (use_hash_index)
+		{
+			HashIndex& hash_index = hash_indexes.find(field.name) -> second;
+			if (! hash_index.is_built() && layout == LAYOUT_COLUMNS)
+			{
+				// Columnar databases pair each id with its field value so the index can be built from them like records
+				std::string pairs;
+				gather_field(mapped_records, FixedString8(field.name), pairs);
+				hash_index.build(type, pairs.data(), record_count, sizeof(unsigned int) + value_size, 0, sizeof(unsigned int));
+			}
+			else if (! hash_index.is_built())
+			{
+				hash_index.build(type, mapped_records, record_count, record_size, id_offset, value_offset);
+			}
+
+			ids = hash_index.search(low);
+		}
+		else
+		{
+			ids = indexes.find(field.name) -> second.search(low, high);
+		}
+		search_lock.unlock();
+
+		std::vector<unsigned int> slots;
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			unsigned int slot = get_slot(ids[i]);
+			if (slot != 0)
+				slots.push_back(slot);
+		}
+
+		std::sort(slots.begin(), slots.end());
+
+		start(1);
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			RecordView record(*this, mapped_records, slots[i]);
+			if (! visitor(0, record))
+				break;
+		}
+
+		return;
+	}
+
+	/* Search records by walking the mapped records in chunks of SCAN_CHUNK records (linear search)
+	* Large scans are shared between worker threads that take the next chunk in turn, and the visitor
+	* is told which chunk each record is in, so records can be returned in file order like a single threaded scan
+	*/
+	unsigned int chunk_count = (record_count + SCAN_CHUNK - 1) / SCAN_CHUNK;
+	unsigned int worker_count = std::min(threads, chunk_count);
+	std::atomic<unsigned int> next_chunk(0);
+	start(chunk_count);
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < worker_count; i++)
+		workers.push_back(std::thread(&DB::scan_chunks, this, predicate, std::cref(field), mapped_records, std::ref(next_chunk),
+			chunk_count, std::cref(visitor)));
+
+	scan_chunks(predicate, field, mapped_records, next_chunk, chunk_count, visitor);
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+/* This function resolves the field compared by a predicate in the loaded file, the caller must hold the database mutex
+* Handles of the loaded schema are used as they are, since current format records are laid out like the schema
+* Returns false if the table has no such field of the predicate type
+*/
+bool DB::resolve_scan_field(DB::Predicate& predicate, DB::ScanField& field)
+{
+	field.type = predicate.get_type();
+
+	const FieldHandle& handle = predicate.get_field();
+	if (format_version != FORMAT_V1 && schema && schema -> has_field(handle))
+	{
+		field.name = handle.get_name();
+		field.id_offset = schema -> get_fields()[0].get_offset();
+		field.offset = handle.get_offset();
+		field.size = handle.get_size();
+		return handle.get_type() == field.type;
+	}
+
+	field.name = predicate.get_name().get();
+	std::map<std::string, int>::iterator field_type = field_types.find(field.name);
+	if (field_type == field_types.end() || field_type -> second != field.type)
+		return false;
+
+	field.id_offset = field_offsets.find(FixedString8("id").get()) -> second;
+	field.offset = field_offsets.find(field.name) -> second;
+	field.size = field_sizes.find(field.name) -> second;
+	return true;
+}
+
+/* This function runs on each scan worker and on the searching thread, the caller must hold the database mutex
+* Chunks are taken in turn until none are left, and each chunk is checked in blocks with the scan kernel
+* for the predicate bounds, which returns a bitmap of matches for each block
+* Blocks never cross a row group, so columnar databases only read the id and desired field columns
+* When the visitor stops the scan, the remaining chunks are taken so no thread starts another one
+*/
+void DB::scan_chunks(DB::Predicate predicate, const ScanField& field, const char* mapped_records, std::atomic<unsigned int>& next_chunk,
+	unsigned int chunk_count, const ScanVisitor& visitor)
+{
+	int type = field.type;
+	unsigned int id_offset = field.id_offset;
+	unsigned int value_offset = field.offset;
+	unsigned int value_size = field.size;
+	unsigned int id_stride = get_value_stride(sizeof(unsigned int));
+	unsigned int value_stride = get_value_stride(value_size);
+
+	// Retrieve the predicate bounds for the field type
+	int int_low = predicate.get_int_low();
+	int int_high = predicate.get_int_high();
+	float float_low = predicate.get_float_low();
+	float float_high = predicate.get_float_high();
+	std::string char16_low = predicate.get_char16_low();
+	std::string char16_high = predicate.get_char16_high();
+
+	for (unsigned int chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++)
+	{
+		unsigned int last = std::min(record_count, (chunk + 1) * SCAN_CHUNK);
+
+		for (unsigned int start = chunk * SCAN_CHUNK; start < last; start += ScanKernel::BLOCK_SIZE)
+		{
+			const char* ids = mapped_records + get_value_position(start + 1, id_offset, sizeof(unsigned int));
+			const char* values = mapped_records + get_value_position(start + 1, value_offset, value_size);
+			unsigned int count = std::min(last - start, ScanKernel::BLOCK_SIZE);
+
+			// Predicates on the id compare the ids as integers, and are only set to match every record
+			uint64_t bitmap = 0;
+			if (type == ATTR_INT || type == ATTR_ID)
+				bitmap = ScanKernel::match_int(ids, values, count, id_stride, value_stride, int_low, int_high, vectorized);
+			else if (type == ATTR_FLOAT)
+				bitmap = ScanKernel::match_float(ids, values, count, id_stride, value_stride, float_low, float_high, vectorized);
+			else if (type == ATTR_CHAR16)
+				bitmap = ScanKernel::match_char16(ids, values, count, id_stride, value_stride, char16_low.c_str(), char16_high.c_str());
+
+			// Visit matching records in the mapped bytes
+			for (unsigned int i = 0; bitmap != 0; i++, bitmap >>= 1)
+			{
+				if ((bitmap & 1) == 0)
+					continue;
+
+				RecordView record(*this, mapped_records, start + i + 1);
+				if (! visitor(chunk, record))
+				{
+					next_chunk = chunk_count;
+					return;
+				}
+			}
+		}
+	}
+}
+
+/* This function calculates the byte offset of each field value within a record from the table layout
+* Version 2 records store the id followed by the field values in table order
+* Version 1 records store named Attrs, with the id first followed by the int, float and char16 fields in table order
+*/
+void DB::build_layout()
+{
+	const std::map<std::string, Field>& fields = table.get_fields();
+	FixedString8 id_name("id");
+	unsigned int name_size = 0;
+
+	if (format_version == FORMAT_V1)
+		name_size = id_name.get_size();
+
+	schema = table.compile();
+	field_offsets.clear();
+	field_sizes.clear();
+	field_types.clear();
+	field_offsets[id_name.get()] = name_size;
+	field_sizes[id_name.get()] = AttrID().get_size();
+	field_types[id_name.get()] = ATTR_ID;
+	unsigned int offset = name_size + AttrID().get_size();
+
+	int types[] = { ATTR_INT, ATTR_FLOAT, ATTR_CHAR16 };
+	int sizes[] = { (int) AttrInt().get_size(), (int) AttrFloat().get_size(), (int) AttrChar16().get_size() };
+	int num_passes = 3;
+
+	// Version 2 records aren't grouped by type, so lay out all fields in one pass
+	if (format_version != FORMAT_V1)
+		num_passes = 1;
+
+	for (int pass = 0; pass < num_passes; pass++)
+	{
+		std::map<std::string, Field>::const_iterator it;
+		for (it = fields.begin(); it != fields.end(); it++)
+		{
+			int type = it -> second.get_type();
+			if (type == ATTR_ID || (num_passes > 1 && type != types[pass]))
+				continue;
+
+			offset += name_size;
+			field_offsets[it -> first] = offset;
+			field_sizes[it -> first] = sizes[type];
+			field_types[it -> first] = type;
+			offset += sizes[type];
+		}
+	}
+}
+
+/* This API function creates a secondary index on a field
+* The index is stored in a side file next to the database file and is used by searches on the field
+*/
+void DB::create_index(std::string name)
+{
+	WriteLock lock(*this);
+	FixedString8 fixed_name(name);
+	std::map<std::string, int>::iterator field_type = field_types.find(fixed_name.get());
+
+	if (! db_file.is_open() || field_type == field_types.end() || field_type -> second == ATTR_ID)
+		return;
+
+	build_index(fixed_name);
+}
+
+/* This API function enables an in-memory hash index on a field for equality searches
+* The hash index is built on the first equality search on the field and is never stored on disk
+*/
+void DB::enable_hash_index(std::string name)
+{
+	WriteLock lock(*this);
+	FixedString8 fixed_name(name);
+	hash_indexes[fixed_name.get()];
+}
+
+/* This API function returns the memory used by the hash index on a field in bytes, or 0 if it isn't built
+* Hash indexes are built by searches, so the search mutex is taken along with the shared lock
+*/
+size_t DB::get_hash_index_memory(std::string name)
+{
+	std::shared_lock<std::shared_timed_mutex> lock(db_mutex);
+	std::lock_guard<std::mutex> search_lock(search_mutex);
+	std::map<std::string, HashIndex>::iterator it = hash_indexes.find(FixedString8(name).get());
+	if (it == hash_indexes.end() || ! it -> second.is_built())
+		return 0;
+
+	return it -> second.get_memory_usage();
+}
+
+// This API function returns the time taken to build the hash index on a field in milliseconds
+double DB::get_hash_index_build_time(std::string name)
+{
+	std::shared_lock<std::shared_timed_mutex> lock(db_mutex);
+	std::lock_guard<std::mutex> search_lock(search_mutex);
+	std::map<std::string, HashIndex>::iterator it = hash_indexes.find(FixedString8(name).get());
+	if (it == hash_indexes.end())
+		return 0;
+
+	return it -> second.get_build_time();
+}
+
+// This function returns the name of the index side file for a field
+std::string DB::get_index_filename(FixedString8 name)
+{
+	std::string field = name.get();
+	field.erase(field.find_last_not_of(' ') + 1);
+
+	return db_name + DB_EXT + INDEX_EXT + field;
+}
+
+// This function opens the index side files that exist for any table field
+void DB::open_indexes()
+{
+	const std::map<std::string, Field>& fields = table.get_fields();
+
+	std::map<std::string, Field>::const_iterator it;
+	for (it = fields.begin(); it != fields.end(); it++)
+	{
+		if (it -> second.get_type() == ATTR_ID)
+			continue;
+
+		if (! indexes[it -> first].open(get_index_filename(it -> second.get_name())))
+			indexes.erase(it -> first);
+	}
+}
+
+// This function builds the index on a field from the current records
+void DB::build_index(FixedString8 name)
+{
+	unsigned int id_offset = field_offsets[FixedString8("id").get()];
+	unsigned int value_offset = field_offsets[name.get()];
+	unsigned int stride = record_size;
+
+	// Make sure any buffered writes are in the file before mapping it
+	flush_file();
+
+	std::string db_filename = db_name + DB_EXT;
+	MappedFile mapped_file;
+	const char* mapped_records = NULL;
+	unsigned int count = 0;
+	if (record_count > 0 && mapped_file.map(db_filename, get_records_offset() + get_records_size(record_count)))
+	{
+		mapped_records = mapped_file.get_data() + get_records_offset();
+		count = record_count;
+	}
+
+	// Columnar databases pair each id with its field value so the index can be built from them like records
+	std::string pairs;
+	if (mapped_records != NULL && layout == LAYOUT_COLUMNS)
+	{
+		gather_field(mapped_records, name, pairs);
+		mapped_records = pairs.data();
+		stride = sizeof(unsigned int) + field_sizes[name.get()];
+		id_offset = 0;
+		value_offset = sizeof(unsigned int);
+	}
+
+	indexes[name.get()].build(get_index_filename(name), field_types[name.get()], mapped_records, count,
+		stride, id_offset, value_offset);
+	header_dirty = true;
+}
+
+/* This function adds or removes a serialized record in every index
+* Records marked as removed are not indexed
+*/
+void DB::update_indexes(const char* record, bool add)
+{
+	unsigned int id;
+	memcpy(&id, record + field_offsets[FixedString8("id").get()], sizeof(unsigned int));
+	if (id == 0)
+		return;
+
+	std::map<std::string, Index>::iterator it;
+	for (it = indexes.begin(); it != indexes.end(); it++)
+	{
+		const char* value = record + field_offsets[it -> first];
+
+		if (add)
+			it -> second.insert(value, id);
+		else
+			it -> second.remove(value, id);
+	}
+
+	// Hash indexes that haven't been built yet will pick up the change when they are built
+	std::map<std::string, HashIndex>::iterator hit;
+	for (hit = hash_indexes.begin(); hit != hash_indexes.end(); hit++)
+	{
+		if (! hit -> second.is_built())
+			continue;
+
+		const char* value = record + field_offsets[hit -> first];
+
+		if (add)
+			hit -> second.insert(value, id);
+		else
+			hit -> second.remove(value, id);
+	}
+}
+
+// This function opens the session stream for reading and writing records
+void DB::open_file(std::string db_filename)
+{
+	db_file.open(db_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	page_cache.clear();
+}
+
+/* This function writes the dirty pages of the page cache back to the database file and flushes the session stream
+* Pages held for write-ahead log entries that haven't been synced can't be written back, so the log is synced first
+*/
+void DB::flush_file()
+{
+	page_cache.release(log_synced);
+	if (page_cache.get_held() > 0)
+	{
+		sync_log();
+		page_cache.release(log_synced);
+	}
+
+	page_cache.flush(db_file);
+	db_file.flush();
+}
+
+/* This function writes the file format information at the start of a database file
+* Version 1 files have no format information, so nothing is written for them
+*/
+void DB::write_format(std::ostream& stream, unsigned int format)
+{
+	if (format == FORMAT_V1)
+		return;
+
+	stream.write(DB_MAGIC.c_str(), DB_MAGIC.size());
+	stream.write(reinterpret_cast<const char*>(&format), sizeof(unsigned int));
+}
+
+/* This function reads the file format information at the start of a database file
+* Version 1 files start directly with the table, so the stream is rewound if no magic string is found
+*/
+unsigned int DB::read_format(std::istream& stream)
+{
+	std::string magic;
+	magic.resize(DB_MAGIC.size());
+	stream.read(&magic[0], DB_MAGIC.size());
+
+	if (! stream || magic != DB_MAGIC)
+	{
+		stream.clear();
+		stream.seekg(0);
+		return FORMAT_V1;
+	}
+
+	unsigned int format;
+	stream.read((char*)&format, sizeof(unsigned int));
+	return format;
+}
+
+// This function writes the cached record header to the database file
+void DB::write_header()
+{
+	generation++;
+	std::string header = build_header(format_version, record_count, record_size, free_slots.size());
+	write_file(db_file, table_offset, header.data(), header.size());
+	header_dirty = false;
+}
+
+// This function writes a record header at the current position of a stream
+void DB::write_header(std::ostream& stream, unsigned int format, unsigned int count, unsigned int size, unsigned int removed)
+{
+	std::string header = build_header(format, count, size, removed);
+	stream.write(header.data(), header.size());
+}
+
+/* This function builds a record header from the session state and the given counts
+* Version 1 and 2 headers only hold the record count and record size
+* Version 3 headers add the live and removed counts, the next id and the header state, followed by a checksum of the header
+* Version 4 headers also hold the storage layout and row group size before the checksum
+* Version 5 headers also hold the generation before the checksum
+*/
+std::string DB::build_header(unsigned int format, unsigned int count, unsigned int size, unsigned int removed)
+{
+	std::string header;
+	header.append(reinterpret_cast<const char*>(&count), sizeof(unsigned int));
+	header.append(reinterpret_cast<const char*>(&size), sizeof(unsigned int));
+
+	if (format >= FORMAT_V3)
+	{
+		unsigned int live = count - removed;
+		header.append(reinterpret_cast<const char*>(&live), sizeof(unsigned int));
+		header.append(reinterpret_cast<const char*>(&removed), sizeof(unsigned int));
+		header.append(reinterpret_cast<const char*>(&next_id), sizeof(unsigned int));
+		header.append(reinterpret_cast<const char*>(&header_state), sizeof(unsigned int));
+
+		if (format >= FORMAT_V4)
+		{
+			header.append(reinterpret_cast<const char*>(&layout), sizeof(unsigned int));
+			header.append(reinterpret_cast<const char*>(&group_rows), sizeof(unsigned int));
+		}
+
+		if (format >= FORMAT_V5)
+			header.append(reinterpret_cast<const char*>(&generation), sizeof(unsigned int));
+
+		unsigned int checksum = get_header_checksum(header);
+		header.append(reinterpret_cast<const char*>(&checksum), sizeof(unsigned int));
+	}
+
+	return header;
+}
+
+/* This function reads the record header of the database file in to the session state
+* The removed count is returned through the argument for version 3 headers
+* Returns false if the header can't be trusted because it is damaged or wasn't closed cleanly
+* An open header is trusted if open_allowed is set, which is when other sessions sharing the file have it open
+*/
+bool DB::read_header(unsigned int& removed, bool open_allowed)
+{
+	std::string header(get_header_size(format_version), '\0');
+	db_file.seekg(table_offset);
+	db_file.read(&header[0], header.size());
+
+	memcpy(&record_count, &header[0], sizeof(unsigned int));
+	memcpy(&record_size, &header[sizeof(unsigned int)], sizeof(unsigned int));
+	next_id = 1;
+	generation = 0;
+	layout = LAYOUT_ROWS;
+	group_rows = GROUP_ROWS;
+
+	/* Databases that never had a record inserted may not have a record size on disk
+	* Calculate it from the table instead and write it out when the database is closed
+	*/
+	if (! db_file)
+	{
+		db_file.clear();
+
+		Record record;
+		record.set_table(table);
+		record.sanitize();
+		record_size = record.get_size(format_version);
+		header_dirty = true;
+		return format_version < FORMAT_V3;
+	}
+
+	if (format_version < FORMAT_V3)
+		return true;
+
+	unsigned int live;
+	unsigned int state;
+	unsigned int checksum;
+	size_t checksum_position = header.size() - sizeof(unsigned int);
+	memcpy(&live, &header[sizeof(unsigned int) * 2], sizeof(unsigned int));
+	memcpy(&removed, &header[sizeof(unsigned int) * 3], sizeof(unsigned int));
+	memcpy(&state, &header[sizeof(unsigned int) * 5], sizeof(unsigned int));
+	memcpy(&checksum, &header[checksum_position], sizeof(unsigned int));
+
+	/* The layout can't be calculated from the records, so it is read before the checksum is checked
+	* and only kept if it holds a known layout and row group size
+	*/
+	if (format_version >= FORMAT_V4)
+	{
+		unsigned int stored_layout;
+		unsigned int stored_group_rows;
+		memcpy(&stored_layout, &header[sizeof(unsigned int) * 6], sizeof(unsigned int));
+		memcpy(&stored_group_rows, &header[sizeof(unsigned int) * 7], sizeof(unsigned int));
+
+		if (stored_layout == LAYOUT_COLUMNS && stored_group_rows == GROUP_ROWS)
+			layout = LAYOUT_COLUMNS;
+	}
+
+	if (format_version >= FORMAT_V5)
+		memcpy(&generation, &header[sizeof(unsigned int) * 8], sizeof(unsigned int));
+
+	// A damaged header is replaced with values calculated from the table and the records
+	if (checksum != get_header_checksum(header.substr(0, checksum_position)) || live + removed != record_count)
+	{
+		Record record;
+		record.set_table(table);
+		record.sanitize();
+		record_size = record.get_size(format_version);
+		return false;
+	}
+
+	memcpy(&next_id, &header[sizeof(unsigned int) * 4], sizeof(unsigned int));
+	return state == HEADER_CLOSED || (open_allowed && state == HEADER_OPEN);
+}
+
+// This function returns the size of the record header for a file format version
+unsigned int DB::get_header_size(unsigned int format)
+{
+	if (format >= FORMAT_V5)
+		return sizeof(unsigned int) * 10;
+
+	if (format >= FORMAT_V4)
+		return sizeof(unsigned int) * 9;
+
+	if (format >= FORMAT_V3)
+		return sizeof(unsigned int) * 7;
+
+	return sizeof(unsigned int) * 2;
+}
+
+// This function calculates the checksum stored at the end of a version 3 header with FNV-1a
+unsigned int DB::get_header_checksum(const std::string& header)
+{
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < header.size(); i++)
+	{
+		hash ^= (unsigned char) header[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/* This function stores a buffer of serialized records with consecutive ids starting at the next id
+* Records fill the slots of removed records first, and the rest are appended after the last record in the file
+* with one write, or one write per column of each row group for columnar databases
+* The new records are added to the id map and any indexes
+* The header is only marked as changed here and written out when the database is closed, or when the operation ends
+* in a shared session
+*/
+void DB::store_records(const std::string& buffer, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	unsigned int reused = 0;
+	for (; reused < count && ! free_slots.empty(); reused++)
+	{
+		unsigned int slot = free_slots.back();
+		free_slots.pop_back();
+
+		write_slots(db_file, get_records_offset(), slot, buffer.data() + (size_t) reused * record_size, 1);
+		id_slots.push_back(slot);
+		mark_slot_changed(slot, 0, next_id + reused);
+	}
+
+	if (reused < count)
+	{
+		write_slots(db_file, get_records_offset(), record_count + 1, buffer.data() + (size_t) reused * record_size, count - reused);
+
+		for (unsigned int i = reused; i < count; i++)
+		{
+			record_count++;
+			id_slots.push_back(record_count);
+		}
+
+		pad_groups(db_file, get_records_offset(), record_count);
+	}
+
+	for (unsigned int i = 0; i < count && (! indexes.empty() || ! hash_indexes.empty()); i++)
+		update_indexes(buffer.data() + (size_t) i * record_size, true);
+
+	next_id += count;
+	header_dirty = true;
+}
+
+/* This function writes bytes at a position in a stream
+* Writes to the session file go through the page cache, and writes to the session file of a logged session
+* are collected for the write-ahead log and applied when the operation ends
+*/
+void DB::write_file(std::ostream& stream, std::streamoff position, const char* data, size_t size)
+{
+	if (&stream == &db_file && log_file.is_open())
+	{
+		uint64_t log_position = position;
+		unsigned int log_size = size;
+		log_writes.append(reinterpret_cast<const char*>(&log_position), sizeof(uint64_t));
+		log_writes.append(reinterpret_cast<const char*>(&log_size), sizeof(unsigned int));
+		log_writes.append(data, size);
+		return;
+	}
+
+	if (&stream == &db_file)
+	{
+		page_cache.write(db_file, position, data, size);
+		return;
+	}
+
+	stream.seekp(position);
+	stream.write(data, size);
+}
+
+// This function calculates the offset of the first record in the database file
+std::streamoff DB::get_records_offset()
+{
+	return table_offset + get_header_size(format_version);
+}
+
+/* This function calculates the number of bytes used by a number of record slots
+* Columnar databases always use whole row groups
+*/
+size_t DB::get_records_size(unsigned int count)
+{
+	if (layout == LAYOUT_COLUMNS)
+		return (size_t) ((count + group_rows - 1) / group_rows) * group_rows * record_size;
+
+	return (size_t) count * record_size;
+}
+
+/* This function calculates the position of a record value from the start of the records
+* The value is given by its offset and size within a serialized record
+*/
+size_t DB::get_value_position(unsigned int slot, unsigned int offset, unsigned int size)
+{
+	if (layout == LAYOUT_COLUMNS)
+	{
+		size_t group = (slot - 1) / group_rows;
+		unsigned int row = (slot - 1) % group_rows;
+		return group * group_rows * record_size + (size_t) offset * group_rows + (size_t) row * size;
+	}
+
+	return (size_t) (slot - 1) * record_size + offset;
+}
+
+// This function returns the distance between the values of consecutive record slots in the same row group
+unsigned int DB::get_value_stride(unsigned int size)
+{
+	if (layout == LAYOUT_COLUMNS)
+		return size;
+
+	return record_size;
+}
+
+// This function copies a record slot from a block of records starting at a row group in to a serialized record
+void DB::read_slot(const char* records, unsigned int slot, char* record)
+{
+	if (layout == LAYOUT_ROWS)
+	{
+		memcpy(record, records + (size_t) (slot - 1) * record_size, record_size);
+		return;
+	}
+
+	std::map<std::string, unsigned int>::iterator it;
+	std::map<std::string, unsigned int>::iterator size_it = field_sizes.begin();
+	for (it = field_offsets.begin(); it != field_offsets.end(); it++, size_it++)
+		memcpy(record + it -> second, records + get_value_position(slot, it -> second, size_it -> second), size_it -> second);
+}
+
+// This function reads a record slot from the database file through the page cache in to a serialized record
+void DB::read_slot(unsigned int slot, char* record)
+{
+	if (layout == LAYOUT_ROWS)
+	{
+		page_cache.read(db_file, get_records_offset() + get_value_position(slot, 0, record_size), record, record_size);
+		return;
+	}
+
+	std::map<std::string, unsigned int>::iterator it;
+	for (it = field_offsets.begin(); it != field_offsets.end(); it++)
+	{
+		unsigned int size = field_sizes[it -> first];
+		page_cache.read(db_file, get_records_offset() + get_value_position(slot, it -> second, size), record + it -> second, size);
+	}
+}
+
+/* This function writes serialized records to consecutive slots starting at a slot
+* Row databases write the records with one write, and columnar databases write each field of each row group touched
+* as one run of values
+*/
+void DB::write_slots(std::ostream& stream, std::streamoff records_offset, unsigned int slot, const char* records, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	if (layout == LAYOUT_ROWS)
+	{
+		write_file(stream, records_offset + get_value_position(slot, 0, record_size), records, (size_t) count * record_size);
+		return;
+	}
+
+	std::string values;
+	while (count > 0)
+	{
+		unsigned int run = std::min(count, group_rows - (slot - 1) % group_rows);
+
+		std::map<std::string, unsigned int>::iterator it;
+		for (it = field_offsets.begin(); it != field_offsets.end(); it++)
+		{
+			unsigned int size = field_sizes[it -> first];
+			values.resize((size_t) run * size);
+			for (unsigned int i = 0; i < run; i++)
+				memcpy(&values[(size_t) i * size], records + (size_t) i * record_size + it -> second, size);
+
+			write_file(stream, records_offset + get_value_position(slot, it -> second, size), values.data(), values.size());
+		}
+
+		slot += run;
+		records += (size_t) run * record_size;
+		count -= run;
+	}
+}
+
+/* This function extends a columnar database file to hold the whole last row group
+* The last byte of the group belongs to a slot past the record count, so writing it leaves the unwritten values as zeros
+* which read as removed records
+*/
+void DB::pad_groups(std::ostream& stream, std::streamoff records_offset, unsigned int count)
+{
+	if (layout == LAYOUT_ROWS || count % group_rows == 0)
+		return;
+
+	char zero = 0;
+	write_file(stream, records_offset + get_records_size(count) - 1, &zero, 1);
+}
+
+/* This function gathers the id and one field value of every record slot of a columnar database in to pairs
+* The pairs are laid out like records of a table with only that field, so indexes can be built from them
+*/
+void DB::gather_field(const char* records, FixedString8 name, std::string& pairs)
+{
+	unsigned int id_offset = field_offsets[FixedString8("id").get()];
+	unsigned int value_offset = field_offsets[name.get()];
+	unsigned int value_size = field_sizes[name.get()];
+	unsigned int pair_size = sizeof(unsigned int) + value_size;
+
+	pairs.resize((size_t) record_count * pair_size);
+	for (unsigned int slot = 1; slot <= record_count; slot++)
+	{
+		char* pair = &pairs[(size_t) (slot - 1) * pair_size];
+		memcpy(pair, records + get_value_position(slot, id_offset, sizeof(unsigned int)), sizeof(unsigned int));
+		memcpy(pair + sizeof(unsigned int), records + get_value_position(slot, value_offset, value_size), value_size);
+	}
+}
+
+// This function returns the slot holding the record with an id, or 0 if there is no such record
+unsigned int DB::get_slot(unsigned int id)
+{
+	if (id == 0 || id >= id_slots.size())
+		return 0;
+
+	return id_slots[id];
+}
+
+// This function returns the name of the id map side file
+std::string DB::get_ids_filename()
+{
+	return db_name + DB_EXT + IDS_EXT;
+}
+
+// This function saves the id map to its side file along with the record count and next id it belongs to
+void DB::write_ids()
+{
+	std::ofstream ids_file(get_ids_filename().c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+	if (! ids_file.is_open())
+		return;
+
+	ids_file.write(IDS_MAGIC.c_str(), IDS_MAGIC.size());
+	ids_file.write(reinterpret_cast<const char*>(&record_count), sizeof(unsigned int));
+	ids_file.write(reinterpret_cast<const char*>(&next_id), sizeof(unsigned int));
+
+	if (next_id > 1)
+		ids_file.write(reinterpret_cast<const char*>(&id_slots[1]), (size_t) (next_id - 1) * sizeof(unsigned int));
+}
+
+/* This function loads the id map saved when the database was last closed and builds the free list from it
+* The side file is removed once it is read, so a database that isn't closed cleanly rebuilds its map from the records
+* Returns false if there is no usable id map for the database file
+*/
+bool DB::read_ids()
+{
+	std::string ids_filename = get_ids_filename();
+	std::ifstream ids_file(ids_filename.c_str(), std::ios::in | std::ios::binary);
+	if (! ids_file.is_open())
+		return false;
+
+	std::string magic;
+	magic.resize(IDS_MAGIC.size());
+	unsigned int slot_count = 0;
+	unsigned int saved_next_id = 0;
+	ids_file.read(&magic[0], IDS_MAGIC.size());
+	ids_file.read((char*)&slot_count, sizeof(unsigned int));
+	ids_file.read((char*)&saved_next_id, sizeof(unsigned int));
+
+	if (! ids_file || magic != IDS_MAGIC || slot_count != record_count || saved_next_id == 0)
+		return false;
+
+	std::vector<unsigned int> saved_slots(saved_next_id, 0);
+	if (saved_next_id > 1)
+		ids_file.read((char*)&saved_slots[1], (size_t) (saved_next_id - 1) * sizeof(unsigned int));
+
+	if (! ids_file)
+		return false;
+
+	// Every slot may hold at most one id, and slots without an id are free
+	std::vector<bool> used(record_count + 1, false);
+	for (unsigned int id = 1; id < saved_next_id; id++)
+	{
+		unsigned int slot = saved_slots[id];
+		if (slot == 0)
+			continue;
+
+		if (slot > record_count || used[slot])
+			return false;
+
+		used[slot] = true;
+	}
+
+	ids_file.close();
+	std::remove(ids_filename.c_str());
+
+	next_id = saved_next_id;
+	id_slots.swap(saved_slots);
+	free_slots.clear();
+	for (unsigned int slot = record_count; slot > 0; slot--)
+	{
+		if (! used[slot])
+			free_slots.push_back(slot);
+	}
+
+	return true;
+}
+
+/* This function rebuilds the id map and free list by reading the stored id of every record slot
+* New ids continue after the largest stored id, or from the minimum next id if it is larger
+*/
+void DB::rebuild_ids(unsigned int min_next_id)
+{
+	std::vector<unsigned int> slot_ids;
+	read_slot_ids(1, slot_ids);
+
+	unsigned int max_id = 0;
+	if (! slot_ids.empty())
+		max_id = *std::max_element(slot_ids.begin(), slot_ids.end());
+
+	next_id = std::max(max_id + 1, min_next_id);
+	id_slots.assign(next_id, 0);
+	free_slots.clear();
+	for (unsigned int slot = record_count; slot > 0; slot--)
+	{
+		unsigned int id = slot_ids[slot - 1];
+		if (id == 0 || id_slots[id] != 0)
+			free_slots.push_back(slot);
+		else
+			id_slots[id] = slot;
+	}
+}
+
+/* This function reads the stored id of every record slot from the first slot given to the last one,
+* in slot order starting with the first slot. The first slot has to start a row group in columnar databases
+*/
+void DB::read_slot_ids(unsigned int first, std::vector<unsigned int>& slot_ids)
+{
+	unsigned int id_offset = field_offsets[FixedString8("id").get()];
+	std::vector<char> chunk;
+	slot_ids.assign(record_count >= first ? record_count - first + 1 : 0, 0);
+
+	// The records are read in large chunks straight from the file, so the page cache is written back first
+	flush_file();
+	db_file.seekg(get_records_offset() + (std::streamoff) get_records_size(first - 1));
+	for (unsigned int start = first; start <= record_count; start += RECORD_CHUNK)
+	{
+		unsigned int chunk_count = record_count - start + 1;
+		if (chunk_count > RECORD_CHUNK)
+			chunk_count = RECORD_CHUNK;
+
+		chunk.resize(get_records_size(chunk_count));
+		db_file.read(&chunk[0], chunk.size());
+
+		for (unsigned int i = 0; i < chunk_count; i++)
+			memcpy(&slot_ids[start - first + i], &chunk[get_value_position(i + 1, id_offset, sizeof(unsigned int))], sizeof(unsigned int));
+	}
+
+	db_file.clear();
+}
+
+// This function returns the name of the side file that sessions sharing the database lock while it is open
+std::string DB::get_lock_filename()
+{
+	return db_name + DB_EXT + LOCK_EXT;
+}
+
+// This function returns the name of the change journal side file of sessions sharing the database
+std::string DB::get_changes_filename()
+{
+	return db_name + DB_EXT + CHANGES_EXT;
+}
+
+/* This function opens the file locks and change journal of a shared session
+* and holds the session lock shared and the file lock exclusively
+* Returns false and leaves the session private if any of the files can't be opened
+*/
+bool DB::open_session()
+{
+	if (! file_lock.open(db_name + DB_EXT) || ! session_lock.open(get_lock_filename()) || ! change_file.open(get_changes_filename())
+		|| ! file_lock.lock(true, true))
+	{
+		file_lock.close();
+		session_lock.close();
+		change_file.close();
+		return false;
+	}
+
+	session_lock.lock(false, true);
+	session_shared = true;
+	return true;
+}
+
+/* This function locks the database file exclusively for an operation in a shared session
+* The caller holds the write mutex but not the database lock, so searches carry on while another session has the file
+*/
+void DB::lock_file()
+{
+	if (! session_shared)
+		return;
+
+	file_lock.lock(true, true);
+}
+
+/* This function catches up with the changes other sessions sharing the database file made since this session's last operation
+* If another session replaced the file the session reopens it first. Nothing else is done if the generation in the header
+* hasn't changed. Otherwise the header is read again, the id map is caught up from the change journal,
+* or rebuilt from every record if the file was replaced, and indexes are reopened or rebuilt on their next search
+* The caller holds the file lock and the database lock exclusively
+*/
+void DB::refresh_session()
+{
+	if (! session_shared)
+		return;
+
+	std::string db_filename = db_name + DB_EXT;
+	bool replaced = false;
+
+	while (file_lock.is_replaced())
+	{
+		db_file.close();
+		open_file(db_filename);
+		file_lock.open(db_filename);
+		file_lock.lock(true, true);
+		replaced = true;
+	}
+
+	unsigned int stored_generation;
+	if (! replaced && read_generation(file_lock, stored_generation) && stored_generation == generation)
+		return;
+
+	unsigned int previous_count = record_count;
+	unsigned int removed = 0;
+	page_cache.clear();
+	bool header_valid = read_header(removed, true);
+
+	/* A running compaction drops its copy if the file it was copying was replaced,
+	* and otherwise copies the slots the journal names again, or every slot if the id map had to be rebuilt
+	*/
+	if (compaction_running && replaced)
+		compaction_replaced = true;
+
+	if (replaced || ! header_valid || record_count < previous_count || ! read_changes(previous_count) || free_slots.size() != removed)
+	{
+		rebuild_ids(next_id);
+		change_offset = change_file.get_size();
+
+		if (compaction_running)
+			compaction_changed.assign(compaction_changed.size(), true);
+	}
+
+	indexes.clear();
+	open_indexes();
+
+	std::map<std::string, HashIndex>::iterator it;
+	for (it = hash_indexes.begin(); it != hash_indexes.end(); it++)
+		it -> second.clear();
+}
+
+/* This function ends every operation that holds the database lock exclusively
+* Shared and logged sessions write the header with every change
+* The writes collected for the write-ahead log are appended to it as one entry, with their size and checksum,
+* then applied to the page cache with their pages held until the entry is synced, and the log is synced once
+* a group of operations has been logged
+* Sessions without a log write their dirty pages back and flush the session stream as each operation ends,
+* so a process that is killed loses none of its operations, while logged sessions leave them
+* in the page cache until they are released and evicted, or the log is checkpointed
+* Returns true if the operation completed a group, and the caller syncs the log once it has released the database lock
+*/
+bool DB::finish_operation()
+{
+	if ((session_shared || log_file.is_open()) && header_dirty)
+		write_header();
+
+	if (! log_file.is_open())
+	{
+		page_cache.flush(db_file);
+		db_file.flush();
+		return false;
+	}
+
+	if (log_writes.empty())
+		return false;
+
+	unsigned int size = log_writes.size();
+	unsigned int checksum = get_header_checksum(log_writes);
+	std::string entry;
+	entry.append(reinterpret_cast<const char*>(&size), sizeof(unsigned int));
+	entry.append(reinterpret_cast<const char*>(&checksum), sizeof(unsigned int));
+	entry.append(log_writes);
+
+	log_file.append(entry);
+	uint64_t sequence = ++log_sequence;
+	page_cache.release(log_synced);
+	apply_log(log_writes, sequence);
+	log_writes.clear();
+
+	if (++log_unsynced < commit_operations)
+		return false;
+
+	log_unsynced = 0;
+	return true;
+}
+
+/* This function ends an operation in a shared session, every buffered write is flushed before the lock is released
+* The slots the operation changed are appended to the change journal, which this session has read up to its end
+*/
+void DB::unlock_file()
+{
+	if (! session_shared)
+		return;
+
+	flush_file();
+
+	std::map<std::string, Index>::iterator it;
+	for (it = indexes.begin(); it != indexes.end(); it++)
+		it -> second.flush();
+
+	if (! change_entries.empty())
+	{
+		change_file.append(change_entries);
+		change_entries.clear();
+		change_offset = change_file.get_size();
+	}
+
+	file_lock.unlock();
+}
+
+/* This function catches the id map up with the changes other sessions sharing the file made since this session's
+* last operation, after the header has been read again
+* The ids of slots appended after the previous record count are read from the file, and the entries appended to
+* the change journal since this session last read it are applied to the slots before it
+* Returns false if the journal doesn't hold whole entries for the file, and the caller rebuilds the id map instead
+*/
+bool DB::read_changes(unsigned int previous_count)
+{
+	const size_t ENTRY_SIZE = sizeof(unsigned int) * 3;
+	size_t change_size = change_file.get_size();
+	if (change_size < change_offset || (change_size - change_offset) % ENTRY_SIZE != 0)
+		return false;
+
+	std::string entries(change_size - change_offset, '\0');
+	if (! entries.empty() && ! change_file.read(change_offset, &entries[0], entries.size()))
+		return false;
+
+	change_offset = change_size;
+	id_slots.resize(next_id, 0);
+
+	// Slots appended since the last operation are skipped here, since their ids are read from the file below
+	for (size_t i = 0; i < entries.size(); i += ENTRY_SIZE)
+	{
+		unsigned int entry[3];
+		memcpy(entry, &entries[i], ENTRY_SIZE);
+
+		unsigned int slot = entry[0];
+		unsigned int old_id = entry[1];
+		unsigned int new_id = entry[2];
+		if (slot == 0 || old_id >= next_id || new_id >= next_id)
+			return false;
+
+		if (slot > previous_count)
+			continue;
+
+		if (compaction_running && slot < compaction_changed.size())
+			compaction_changed[slot] = true;
+
+		if (old_id == new_id)
+			continue;
+
+		if (old_id != 0 && id_slots[old_id] == slot)
+		{
+			id_slots[old_id] = 0;
+			free_slots.push_back(slot);
+		}
+
+		if (new_id != 0)
+		{
+			std::vector<unsigned int>::reverse_iterator free_slot = std::find(free_slots.rbegin(), free_slots.rend(), slot);
+			if (free_slot != free_slots.rend())
+				free_slots.erase(std::next(free_slot).base());
+
+			id_slots[new_id] = slot;
+		}
+	}
+
+	if (record_count == previous_count)
+		return true;
+
+	// Columnar files are read from the start of the row group the first new slot is in
+	unsigned int first = previous_count + 1;
+	if (layout == LAYOUT_COLUMNS)
+		first = previous_count / group_rows * group_rows + 1;
+
+	std::vector<unsigned int> slot_ids;
+	read_slot_ids(first, slot_ids);
+	for (unsigned int slot = record_count; slot > previous_count; slot--)
+	{
+		unsigned int id = slot_ids[slot - first];
+		if (id == 0 || id >= next_id || id_slots[id] != 0)
+			free_slots.push_back(slot);
+		else
+			id_slots[id] = slot;
+	}
+
+	return true;
+}
+
+/* This function records that an operation wrote an existing record slot, with the id stored in it before and after
+* A running compaction copies the slot again, and a shared session adds it to the change journal entries of the operation
+*/
+void DB::mark_slot_changed(unsigned int slot, unsigned int old_id, unsigned int new_id)
+{
+	if (compaction_running && slot < compaction_changed.size())
+		compaction_changed[slot] = true;
+
+	if (! session_shared)
+		return;
+
+	unsigned int entry[3] = { slot, old_id, new_id };
+	change_entries.append(reinterpret_cast<const char*>(entry), sizeof(entry));
+}
+
+/* This function locks the database file shared for a search in a shared session
+* Searches that run at the same time share the lock, so only the first one locks the search handle,
+* which is kept open between searches and only opened again once the file has been replaced
+* The caller holds the database lock, so the file lock isn't waited for, since writers wait for it before the database lock
+* Returns false if a writer holds the file lock, or if another session changed or replaced the file since this session's
+* last operation, in which case the lock is released again and stale is set
+*/
+bool DB::lock_search(bool& stale)
+{
+	std::lock_guard<std::mutex> count_lock(search_file_mutex);
+	stale = false;
+	if (search_file_count > 0)
+	{
+		search_file_count++;
+		return true;
+	}
+
+	std::string db_filename = db_name + DB_EXT;
+	if ((! search_file_lock.is_open() || search_file_lock.is_replaced()) && ! search_file_lock.open(db_filename))
+	{
+		search_file_count++;
+		return true;
+	}
+
+	if (! search_file_lock.lock(false, false))
+		return false;
+
+	unsigned int stored_generation;
+	if (! search_file_lock.is_replaced() && (! read_generation(search_file_lock, stored_generation) || stored_generation == generation))
+	{
+		search_file_count++;
+		return true;
+	}
+
+	search_file_lock.unlock();
+	stale = true;
+	return false;
+}
+
+// This function ends a search in a shared session, and the last search running unlocks the search handle
+void DB::unlock_search()
+{
+	std::lock_guard<std::mutex> count_lock(search_file_mutex);
+	if (--search_file_count == 0)
+		search_file_lock.unlock();
+}
+
+// This function reads the generation from the header of a locked database file
+bool DB::read_generation(FileLock& lock, unsigned int& stored_generation)
+{
+	if (format_version < FORMAT_V5)
+		return false;
+
+	return lock.read(table_offset + sizeof(unsigned int) * 8, reinterpret_cast<char*>(&stored_generation), sizeof(unsigned int));
+}
+
+// This function returns the name of the write-ahead log side file
+std::string DB::get_log_filename()
+{
+	return db_name + DB_EXT + LOG_EXT;
+}
+
+// This function opens the write-ahead log for appending and starts the log worker
+void DB::open_log()
+{
+	if (! log_file.open(get_log_filename()))
+		return;
+
+	if (log_file.get_size() == 0)
+		log_file.append(LOG_MAGIC);
+
+	log_unsynced = 0;
+	log_stopping = false;
+	log_thread = std::thread(&DB::run_log, this);
+}
+
+/* This function applies every complete entry in the write-ahead log to the database file, then removes the log
+* Entries are applied in order up to the first one that is cut short or fails its checksum,
+* which is an operation that was still being logged when the session stopped
+* Returns false if there is no log for the database file
+*/
+bool DB::replay_log()
+{
+	std::string log_filename = get_log_filename();
+	std::ifstream log(log_filename.c_str(), std::ios::in | std::ios::binary);
+	if (! log.is_open())
+		return false;
+
+	log.seekg(0, std::ios::end);
+	std::streamoff log_size = log.tellg();
+	log.seekg(0);
+
+	std::string magic;
+	magic.resize(LOG_MAGIC.size());
+	log.read(&magic[0], LOG_MAGIC.size());
+	if (! log || magic != LOG_MAGIC)
+		return false;
+
+	std::string writes;
+	unsigned int size;
+	unsigned int checksum;
+	while (log.read((char*)&size, sizeof(unsigned int)) && log.read((char*)&checksum, sizeof(unsigned int)))
+	{
+		if (size > log_size - log.tellg())
+			break;
+
+		writes.resize(size);
+		log.read(&writes[0], size);
+		if (! log || checksum != get_header_checksum(writes))
+			break;
+
+		apply_log(writes, 0);
+	}
+
+	log.close();
+
+	// The replayed writes are synced before the log is removed
+	sync_db_file();
+	std::remove(log_filename.c_str());
+	return true;
+}
+
+/* This function applies the writes of a write-ahead log entry to the database file through the page cache
+* The pages of an entry with a sequence number are held until the log is synced past it
+* If a write can't be held, because it is too large to cache or the cache is already half held, the log is synced first,
+* which makes the entry durable, and the rest of the entry is written without holding its pages
+* Replayed entries have no sequence number, since they are already on the disk
+*/
+void DB::apply_log(const std::string& writes, uint64_t sequence)
+{
+	size_t position = 0;
+	while (position + sizeof(uint64_t) + sizeof(unsigned int) <= writes.size())
+	{
+		uint64_t file_position;
+		unsigned int size;
+		memcpy(&file_position, &writes[position], sizeof(uint64_t));
+		memcpy(&size, &writes[position + sizeof(uint64_t)], sizeof(unsigned int));
+		position += sizeof(uint64_t) + sizeof(unsigned int);
+
+		if (position + size > writes.size())
+			break;
+
+		if (sequence != 0 && ! page_cache.can_hold(file_position, size))
+		{
+			sync_log();
+			page_cache.release(log_synced);
+			sequence = 0;
+		}
+
+		page_cache.write(db_file, file_position, &writes[position], size, sequence);
+		position += size;
+	}
+}
+
+/* This function syncs the write-ahead log to the disk and records the number of the last entry the sync covered
+* The number is taken before the sync, so it never covers an entry appended while the sync runs
+* The log worker syncs without the database mutex, so the number only ever moves forward
+*/
+void DB::sync_log()
+{
+	uint64_t sequence = log_sequence;
+	log_file.sync();
+
+	uint64_t synced = log_synced;
+	while (synced < sequence)
+	{
+		if (log_synced.compare_exchange_weak(synced, sequence))
+			break;
+	}
+}
+
+/* This function checkpoints the write-ahead log, the caller must hold the database mutex
+* Syncing the database file syncs the log first if pages are still held, which writes back every logged operation,
+* so once the file is synced the log is emptied
+*/
+void DB::checkpoint_log()
+{
+	sync_db_file();
+	log_file.truncate(LOG_MAGIC.size());
+	log_unsynced = 0;
+}
+
+/* This function checkpoints and closes the write-ahead log when the database is closed
+* The log is removed unless other sessions sharing the database still have it open
+*/
+void DB::close_log(bool last_session)
+{
+	if (! log_file.is_open())
+		return;
+
+	sync_db_file();
+	log_file.close();
+
+	if (last_session)
+		std::remove(get_log_filename().c_str());
+}
+
+// This function flushes the session stream and syncs the database file to the disk
+void DB::sync_db_file()
+{
+	flush_file();
+	sync_file(db_name + DB_EXT);
+}
+
+// This function syncs a file that isn't open for writing to the disk
+void DB::sync_file(std::string filename)
+{
+	LogFile file;
+	if (file.open(filename))
+		file.sync();
+}
+
+/* This function runs on the log worker while the write-ahead log is open
+* Every commit interval it syncs the log if operations were logged since the last sync,
+* and it checkpoints the log once it reaches the checkpoint size
+*/
+void DB::run_log()
+{
+	std::unique_lock<std::mutex> wake_lock(log_mutex);
+	while (! log_stopping)
+	{
+		unsigned int interval = commit_interval;
+		unsigned int wait = interval;
+		if (wait == 0)
+			wait = LOG_CHECK_INTERVAL;
+
+		log_wake.wait_for(wake_lock, std::chrono::milliseconds(wait));
+		if (log_stopping)
+			break;
+
+		wake_lock.unlock();
+
+		if (interval > 0 && log_unsynced.exchange(0) > 0)
+			sync_log();
+
+		// Most of the database file is synced before taking the lock, so the lock is only held for a short sync
+		if (log_file.get_size() >= LOG_CHECKPOINT_SIZE)
+		{
+			sync_file(db_name + DB_EXT);
+
+			WriteLock lock(*this);
+			checkpoint_log();
+		}
+
+		wake_lock.lock();
+	}
+}
+
+// This function stops the log worker, the caller must not hold the database mutex
+void DB::stop_log()
+{
+	{
+		std::lock_guard<std::mutex> wake_lock(log_mutex);
+		log_stopping = true;
+	}
+
+	log_wake.notify_all();
+	if (log_thread.joinable())
+		log_thread.join();
 }
@@ -11,18 +11,51 @@
 #include <sstream>
 #include <fstream>
 #include <iomanip>
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
 #include <map>
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
 
 /* Define constants for the database API
 *
 */
 const std::string DB_EXT = ".pb";
 const std::string TEMP_EXT = ".tmp";
+const std::string DB_MAGIC = "PBDB";
+const std::string INDEX_EXT = ".idx.";
+const std::string INDEX_MAGIC = "PBIX";
+const std::string IDS_EXT = ".ids";
+const std::string IDS_MAGIC = "PBID";
+const std::string LOCK_EXT = ".lock";
+const std::string CHANGES_EXT = ".chg";
+const std::string LOG_EXT = ".wal";
+const std::string LOG_MAGIC = "PBWL";
+const std::string EXPORT_MAGIC = "PBEX";
 
 /* This class defines the public DB API
 * Its member functions provide end user functionality such as
 * database creation and record insertion
+*
+* A DB object can be shared between threads. Searches share the database lock and run at the same time, and records
+* can't change while a search holds it, so a search sees every change made before it started and none made while
+* it runs. Record operations and other changes run one at a time, and only take the database lock alone while they
+* change records and the in-memory state, so searches don't wait while a writer waits for the file lock of a shared
+* database or syncs the write-ahead log. The lock is a reader/writer lock, so a writer waits for running searches
+* to finish, and searches that start while a writer is waiting queue behind it. Background compaction only takes
+* the lock to start and to swap in the new file.
+*
+* A database can also be shared between processes. Each session then takes a lock on the database file around
+* every operation and picks up the changes other sessions made since its last operation from the record header.
 */
 class DB
 {
@@ -31,7 +64,52 @@ class DB
 		
 		// Define important constants for manipulating the database
 		static const int ATTR_ID = -1;
-		static const int REMOVED_THRESHOLD_DENOM = 2;
+		static const int ATTR_NONE = -2;
+		static const unsigned int RECORD_CHUNK = 4096;
+
+		/* Define the number of record slots in each row group of a columnar database
+		* Row groups hold whole blocks of scan kernel records, and record chunks hold whole row groups
+		*/
+		static const unsigned int GROUP_ROWS = 1024;
+
+		/* Define the number of record slots scanned by a worker thread at a time
+		* Scan chunks hold whole row groups, and scans with a single chunk aren't shared between threads
+		*/
+		static const unsigned int SCAN_CHUNK = 65536;
+
+		/* Define the on-disk file format versions
+		* Version 1 files prefix every record value with its 8 character field name
+		* Version 2 files start with a magic string and store records as packed values in table order
+		* Version 3 files extend the record header with the live and removed counts, the next id,
+		* the header state and a checksum so loads don't have to read the records
+		* Version 4 files add the storage layout and row group size to the record header
+		* Version 5 files add a generation to the record header that changes every time the header is written
+		*/
+		static const unsigned int FORMAT_V1 = 1;
+		static const unsigned int FORMAT_V2 = 2;
+		static const unsigned int FORMAT_V3 = 3;
+		static const unsigned int FORMAT_V4 = 4;
+		static const unsigned int FORMAT_V5 = 5;
+		static const unsigned int FORMAT_CURRENT = FORMAT_V5;
+
+		/* Define the states of a version 3 record header
+		* The header is marked open while a session has the file open and closed once it is written out on close,
+		* so a file that still has an open header wasn't closed cleanly and its records are verified on load
+		*/
+		static const unsigned int HEADER_CLOSED = 0;
+		static const unsigned int HEADER_OPEN = 1;
+
+		/* Define the size the write-ahead log can reach before it is checkpointed in to the database file
+		* and how often the log worker checks it when group commits aren't timed
+		*/
+		static const size_t LOG_CHECKPOINT_SIZE = 16 * 1024 * 1024;
+		static const unsigned int LOG_CHECK_INTERVAL = 100;
+
+		// Define the default size of the page cache for the database file
+		static const size_t CACHE_SIZE = 4 * 1024 * 1024;
+
+		// Define the size exported records are collected up to before they are written to the output stream
+		static const size_t EXPORT_BUFFER_SIZE = 1024 * 1024;
 
 		// This utility class defines a fixed-width string type
 		template <int size>
@@ -55,7 +133,7 @@ class DB
 				}
 
 				// This function reads a fixed length string from disk
-				void read(std::fstream& stream)
+				void read(std::istream& stream)
 				{
 					// Read the string from disk
 					std::string temp_name;
@@ -129,8 +207,8 @@ class DB
 			// This block defines functions for handling ID Attr information
 			public:
 				AttrID();
-				void write(std::fstream& stream);
-				void read(std::fstream& stream);
+				void write(std::ostream& stream, unsigned int format);
+				void read(std::istream& stream);
 				void set_data(const unsigned int data);
 				unsigned int get_data();
 				unsigned int get_size();
@@ -148,8 +226,8 @@ class DB
 			// This block defines functions for handling integer Attr information
 			public:
 				AttrInt();
-				void write(std::fstream& stream);
-				void read(std::fstream& stream);
+				void write(std::ostream& stream, unsigned int format);
+				void read(std::istream& stream);
 				void set_data(const int data);
 				int get_data();
 				unsigned int get_size();
@@ -167,8 +245,8 @@ class DB
 			// This block defines functions for handling floating point Attr information
 			public:
 				AttrFloat();
-				void write(std::fstream& stream);
-				void read(std::fstream& stream);
+				void write(std::ostream& stream, unsigned int format);
+				void read(std::istream& stream);
 				void set_data(const float data);
 				float get_data();
 				unsigned int get_size();
@@ -188,8 +266,8 @@ class DB
 			// This block defines functions for handling floating point Attr information
 			public:
 				AttrChar16();
-				void write(std::fstream& stream);
-				void read(std::fstream& stream);
+				void write(std::ostream& stream, unsigned int format);
+				void read(std::istream& stream);
 				void set_data(std::string data);
 				std::string get_data();
 				unsigned int get_size();
@@ -209,13 +287,258 @@ class DB
 			public:
 				Field();
 				Field(unsigned int size);
-				void write(std::fstream& stream);
-				void read(std::fstream& stream);
+				void write(std::ostream& stream);
+				void read(std::istream& stream);
 				void set_name(FixedString8 name);
 				void set_type(int type);
-				unsigned int get_size();
-				FixedString8 get_name();
-				int get_type();
+				unsigned int get_size() const;
+				FixedString8 get_name() const;
+				int get_type() const;
+		};
+
+		/* This class maps a read-only view of a database file in to memory
+		* Record scans walk the mapped bytes directly instead of reading records through a stream
+		*/
+		class MappedFile
+		{
+			// This block defines variables for storing the mapping
+			private:
+				const char* data;
+				size_t length;
+				std::vector<char> buffer;
+
+				MappedFile(const MappedFile&);
+				MappedFile& operator=(const MappedFile&);
+
+			// This block defines functions for handling the mapping
+			public:
+				MappedFile();
+				~MappedFile();
+				bool map(std::string filename, size_t length);
+				void unmap();
+				const char* get_data();
+				size_t get_length();
+		};
+
+		/* This class holds an advisory lock on a file that is shared with other processes
+		* Locks are held per open file, so two FileLock objects on the same file exclude each other even in one process
+		*/
+		class FileLock
+		{
+			// This block defines variables for storing the open file
+			private:
+				intptr_t handle;
+				std::string filename;
+				bool locked;
+
+				FileLock(const FileLock&);
+				FileLock& operator=(const FileLock&);
+
+			// This block defines functions for locking the file
+			public:
+				FileLock();
+				~FileLock();
+				bool open(std::string filename);
+				bool lock(bool exclusive, bool wait);
+				void unlock();
+				bool read(std::streamoff offset, char* data, size_t size);
+				bool is_replaced();
+				void close();
+				bool is_open();
+		};
+
+		/* This class appends to a file through an unbuffered handle and syncs it to the disk
+		* It holds the write-ahead log and the change journal of shared sessions, and syncs the database file
+		* when the log is checkpointed
+		*/
+		class LogFile
+		{
+			// This block defines variables for storing the open file
+			private:
+				intptr_t handle;
+
+				LogFile(const LogFile&);
+				LogFile& operator=(const LogFile&);
+
+			// This block defines functions for writing the file
+			public:
+				LogFile();
+				~LogFile();
+				bool open(std::string filename);
+				bool append(const std::string& data);
+				bool read(size_t offset, char* data, size_t size);
+				bool sync();
+				bool truncate(size_t size);
+				size_t get_size();
+				void close();
+				bool is_open();
+
+				static bool replace(std::string source, std::string target);
+				static bool rename_file(std::string source, std::string target);
+				static void sync_directory(std::string filename);
+		};
+
+		/* This class caches fixed-size pages of the database file for reads and writes made through the session stream
+		* Changed pages are held dirty and written back when they are evicted or the cache is flushed,
+		* and pages are evicted with the CLOCK algorithm once the cache holds its capacity
+		* Reads and writes larger than a quarter of the cache go straight to the file so they don't evict every page
+		* Pages changed by a write-ahead log entry are held with the sequence number of the entry, and held pages are
+		* never evicted or written back until the log is synced past the entry and the sequence number is released
+		*/
+		class PageCache
+		{
+			// This block defines the cached pages and access counters
+			private:
+				struct Page
+				{
+					size_t number;
+					std::vector<char> data;
+					size_t dirty_begin;
+					size_t dirty_end;
+					bool dirty;
+					bool referenced;
+					uint64_t hold;
+				};
+
+				std::vector<Page> pages;
+				std::map<size_t, size_t> page_frames;
+				size_t capacity;
+				size_t hand;
+				size_t hits;
+				size_t misses;
+				uint64_t released;
+				size_t held;
+
+				size_t find_page(std::fstream& file, size_t number);
+				bool is_held(const Page& page);
+				void write_back(std::fstream& file, Page& page);
+				void write_back_range(std::fstream& file, std::streamoff position, size_t size);
+				size_t get_bypass_size();
+
+			// This block defines functions for reading and writing through the cache
+			public:
+				static const unsigned int PAGE_SIZE = 4096;
+
+				PageCache();
+				void set_capacity(std::fstream& file, size_t capacity);
+				void read(std::fstream& file, std::streamoff position, char* data, size_t size);
+				void write(std::fstream& file, std::streamoff position, const char* data, size_t size, uint64_t hold = 0);
+				bool can_hold(std::streamoff position, size_t size);
+				void release(uint64_t sequence);
+				void flush(std::fstream& file);
+				void clear();
+				size_t get_held();
+				size_t get_hits();
+				size_t get_misses();
+		};
+
+		/* This class provides kernels that evaluate a range predicate over a block of mapped records
+		* Each kernel checks low <= value <= high for up to BLOCK_SIZE records, skipping removed records,
+		* and returns a bitmap with one bit set per matching record
+		* The ids and values of consecutive records are id_stride and value_stride bytes apart, which is the record size
+		* for row databases and the value size for the columns of a row group in columnar databases
+		* AVX2 versions are selected at runtime when the CPU supports them, otherwise scalar versions are used
+		*/
+		class ScanKernel
+		{
+			// This block defines functions for evaluating predicates
+			public:
+				static const unsigned int BLOCK_SIZE = 64;
+
+				static bool has_avx2();
+				static uint64_t match_int(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+					unsigned int value_stride, int low, int high, bool vectorized);
+				static uint64_t match_float(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+					unsigned int value_stride, float low, float high, bool vectorized);
+				static uint64_t match_char16(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+					unsigned int value_stride, const char* low, const char* high);
+		};
+
+		/* This class stores a persistent B+-tree index on a single field in a side file
+		* Entries are the field value encoded so that byte order matches value order, followed by the record id
+		* The file is made of fixed-size pages, with page 0 holding the index metadata
+		*/
+		class Index
+		{
+			// This block defines variables and structures for storing the index
+			private:
+				struct Node
+				{
+					bool leaf;
+					unsigned int next;
+					std::vector<std::string> entries;
+					std::vector<unsigned int> children;
+				};
+
+				std::fstream index_file;
+				int type;
+				unsigned int key_size;
+				unsigned int root;
+				unsigned int page_count;
+
+				Index(const Index&);
+				Index& operator=(const Index&);
+
+				std::string encode(const char* value, unsigned int id);
+				unsigned int get_leaf_capacity();
+				unsigned int get_internal_capacity();
+				void read_node(unsigned int page, Node& node);
+				void write_node(unsigned int page, Node& node);
+				void write_meta();
+
+			// This block defines functions for maintaining and searching the index
+			public:
+				static const unsigned int PAGE_SIZE = 4096;
+
+				Index();
+				bool open(std::string filename);
+				void build(std::string filename, int type, const char* records, unsigned int count, unsigned int record_size,
+					unsigned int id_offset, unsigned int value_offset);
+				void insert(const char* value, unsigned int id);
+				void remove(const char* value, unsigned int id);
+				std::vector<unsigned int> search(const char* low, const char* high);
+				void flush();
+				void close();
+		};
+
+		/* This class stores an in-memory hash index on a single field for equality searches
+		* Distinct field values are kept in an open addressing table with linear probing,
+		* and each value holds the list of ids of the records that contain it
+		*/
+		class HashIndex
+		{
+			// This block defines variables for storing the hash table
+			private:
+				static const char SLOT_EMPTY = 0;
+				static const char SLOT_USED = 1;
+				static const char SLOT_DELETED = 2;
+
+				int type;
+				unsigned int key_size;
+				bool built;
+				double build_time;
+				size_t used_count;
+				size_t deleted_count;
+				std::vector<char> keys;
+				std::vector<char> states;
+				std::vector<std::vector<unsigned int> > postings;
+
+				std::string normalize(const char* value);
+				size_t find_slot(const std::string& key, bool inserting);
+				void resize(size_t capacity);
+
+			// This block defines functions for maintaining and searching the hash index
+			public:
+				HashIndex();
+				void build(int type, const char* records, unsigned int count, unsigned int record_size,
+					unsigned int id_offset, unsigned int value_offset);
+				void clear();
+				bool is_built();
+				void insert(const char* value, unsigned int id);
+				void remove(const char* value, unsigned int id);
+				std::vector<unsigned int> search(const char* value);
+				size_t get_memory_usage();
+				double get_build_time();
 		};
 
 	// This block exposes public database API functions as well as public data types
@@ -223,6 +546,50 @@ class DB
 		
 		// This enum declares the available Field datatypes in the database
 		enum ATTR_TYPES { ATTR_INT, ATTR_FLOAT, ATTR_CHAR16 };
+
+		// This enum declares the available comparison operators for search predicates
+		enum COMPARE_OPS { OP_EQ, OP_LT, OP_LE, OP_GT, OP_GE };
+
+		// This enum declares the states reported for background compaction
+		enum COMPACTION_STATES { COMPACTION_IDLE, COMPACTION_RUNNING };
+
+		// This enum declares the steps of replacing the database file that compaction reports to a compaction hook
+		enum COMPACTION_STEPS { COMPACTION_WRITTEN, COMPACTION_SYNCED, COMPACTION_RENAMED, COMPACTION_DIRECTORY_SYNCED };
+
+		// This enum declares the storage layouts a database can be created with
+		enum LAYOUTS { LAYOUT_ROWS, LAYOUT_COLUMNS };
+
+		// This enum declares the formats records can be exported in
+		enum EXPORT_FORMATS { EXPORT_CSV, EXPORT_JSON, EXPORT_BINARY };
+
+		class Schema;
+
+		/* This class identifies a field of a compiled schema by its normalized name, type, size and offset in a record
+		* Handles are looked up by name once, then passed to record accessors, predicates and searches
+		* so they don't normalize and look up the name again. A default handle matches no field
+		*/
+		class FieldHandle
+		{
+			// This block defines variables for storing the field
+			private:
+				std::string name;
+				int type;
+				unsigned int index;
+				unsigned int offset;
+				unsigned int size;
+
+			// This block defines functions for reading the field
+			public:
+				FieldHandle();
+				FieldHandle(std::string name, int type, unsigned int index, unsigned int offset, unsigned int size);
+				bool is_valid() const;
+				const std::string& get_name() const;
+				int get_type() const;
+				unsigned int get_index() const;
+				unsigned int get_offset() const;
+				unsigned int get_size() const;
+				bool matches(const FieldHandle& field) const;
+		};
 	
 		// This class stores table information
 		class Table
@@ -233,11 +600,12 @@ class DB
 				
 			// This block defines functions for setting table information
 			public:
-				void write(std::fstream& stream);
-				void read(std::fstream& stream);
+				void write(std::ostream& stream);
+				void read(std::istream& stream);
 				void add_field(std::string name, int type);
-				std::map<std::string, Field> get_fields();
+				const std::map<std::string, Field>& get_fields() const;
 				bool is_field(std::string name);
+				std::shared_ptr<const Schema> compile() const;
 		};
 
 		// This class stores a record built of dynamically specified Attrs
@@ -254,11 +622,13 @@ class DB
 				std::map<std::string, AttrInt> attr_ints;
 				std::map<std::string, AttrFloat> attr_floats;
 				std::map<std::string, AttrChar16> attr_char16s;
+
+				void read_attr(std::istream& stream, FixedString8 name, int type);
 		
 			// This block defines functions for building and searching records
 			public:
-				void write(std::fstream& stream);
-				void read(std::fstream& stream);
+				void write(std::ostream& stream, unsigned int format);
+				void read(std::istream& stream, unsigned int format);
 				void set_table(Table table);
 				void set_id(unsigned int id);
 				void add_int(std::string name, int data);
@@ -268,30 +638,625 @@ class DB
 				int get_int(std::string name);
 				float get_float(std::string name);
 				std::string get_char16(std::string name);
-				int get_size();
+				int get_size(unsigned int format);
 				void sanitize();
 		};
 
+		/* This class stores the compiled record layout of a table
+		* The type, size and offset of each field in a serialized record are calculated once when the table is compiled,
+		* and the schema never changes afterwards, so it is shared by the records built on it
+		* The record id comes first, followed by the table fields in table order
+		*/
+		class Schema
+		{
+			// This block defines variables for storing the field layout
+			private:
+				Table table;
+				std::vector<FieldHandle> fields;
+				std::map<std::string, unsigned int> field_indexes;
+				unsigned int record_size;
+
+			// This block defines functions for looking up fields
+			public:
+				Schema(Table table);
+				FieldHandle get_field(std::string name) const;
+				const std::vector<FieldHandle>& get_fields() const;
+				bool has_field(const FieldHandle& field) const;
+				unsigned int get_record_size() const;
+				Table get_table() const;
+				bool matches(const Schema& schema) const;
+		};
+
+		/* This class stores a record as one buffer of values laid out like a record in the database file
+		* The buffer is allocated once when the record is created, and fields are read and written through
+		* handles from its schema at their precomputed offsets
+		* Values that aren't set are 0, or spaces for character fields, like a sanitized Record
+		*/
+		class FlatRecord
+		{
+			// This block defines variables for storing the record
+			private:
+				std::shared_ptr<const Schema> schema;
+				std::string values;
+
+				char* get_value(const FieldHandle& field, int type);
+
+			// This block defines functions for building and reading records
+			public:
+				FlatRecord(std::shared_ptr<const Schema> schema);
+				FlatRecord(std::shared_ptr<const Schema> schema, const char* values);
+				void set_id(unsigned int id);
+				void set_int(const FieldHandle& field, int data);
+				void set_float(const FieldHandle& field, float data);
+				void set_char16(const FieldHandle& field, std::string data);
+				unsigned int get_id();
+				int get_int(const FieldHandle& field);
+				float get_float(const FieldHandle& field);
+				std::string get_char16(const FieldHandle& field);
+				std::shared_ptr<const Schema> get_schema() const;
+				const std::string& get_values() const;
+				Record get_record() const;
+		};
+
+		/* This class stores a search predicate on a single field
+		* Every comparison is stored as an inclusive range of values so it can be checked
+		* directly against the stored field values while records are scanned
+		*/
+		class Predicate
+		{
+			// This block defines variables for storing the predicate
+			private:
+				FixedString8 name;
+				FieldHandle field;
+				int type;
+				int int_low;
+				int int_high;
+				float float_low;
+				float float_high;
+				std::string char16_low;
+				std::string char16_high;
+
+				void set_name(std::string name);
+				void set_int_bounds(int op, int value);
+				void set_float_bounds(int op, float value);
+				void set_char16_bounds(int op, std::string value);
+
+			// This block defines functions for building predicates
+			public:
+				Predicate();
+				void set_int(std::string name, int op, int value);
+				void set_float(std::string name, int op, float value);
+				void set_char16(std::string name, int op, std::string value);
+				void set_int_range(std::string name, int low, int high);
+				void set_float_range(std::string name, float low, float high);
+				void set_char16_range(std::string name, std::string low, std::string high);
+				void set_int(const FieldHandle& field, int op, int value);
+				void set_float(const FieldHandle& field, int op, float value);
+				void set_char16(const FieldHandle& field, int op, std::string value);
+				void set_int_range(const FieldHandle& field, int low, int high);
+				void set_float_range(const FieldHandle& field, float low, float high);
+				void set_char16_range(const FieldHandle& field, std::string low, std::string high);
+				void set_all();
+				FixedString8 get_name();
+				const FieldHandle& get_field();
+				int get_type();
+				int get_int_low();
+				int get_int_high();
+				float get_float_low();
+				float get_float_high();
+				std::string get_char16_low();
+				std::string get_char16_high();
+		};
+
+		class Row;
+
+		/* This class reads the fields of a record matched by a streaming search in place, without building a Record
+		* A view is only valid inside the visitor it is passed to, since it points at the mapped database file
+		*/
+		class RecordView
+		{
+			// This block defines variables for locating the record
+			private:
+				DB& db;
+				const char* records;
+				unsigned int slot;
+
+				const char* get_value(std::string name, int type);
+				const char* get_value(const FieldHandle& field, int type);
+
+				friend class Row;
+				friend class DB;
+
+			// This block defines functions for reading the record
+			public:
+				RecordView(DB& db, const char* records, unsigned int slot);
+				unsigned int get_id();
+				int get_int(std::string name);
+				float get_float(std::string name);
+				std::string get_char16(std::string name);
+				int get_int(const FieldHandle& field);
+				float get_float(const FieldHandle& field);
+				std::string get_char16(const FieldHandle& field);
+				Record get_record();
+				FlatRecord get_flat_record();
+		};
+
+	private:
+
+		/* Store the layout of the rows returned by a projected search
+		* Each selected field is copied from its offset in the record to its offset in the row values
+		*/
+		struct RowField
+		{
+			unsigned int record_offset;
+			unsigned int offset;
+			unsigned int size;
+			int type;
+		};
+
+		typedef std::map<std::string, RowField> RowLayout;
+
+		/* This class allocates the values of the rows returned by a search from large blocks
+		* Each allocation takes the next bytes of the current block, and nothing is freed until the arena is destroyed,
+		* so the rows of a search cost a few block allocations instead of one allocation per row
+		* Each scan chunk fills its own arena, so arenas aren't shared between threads
+		*/
+		class Arena
+		{
+			// This block defines variables for storing the blocks
+			private:
+				std::vector<std::unique_ptr<char[]> > blocks;
+				size_t block_used;
+				size_t allocations;
+
+				Arena(const Arena&);
+				Arena& operator=(const Arena&);
+
+			// This block defines functions for allocating from the arena
+			public:
+				static const size_t BLOCK_SIZE = 64 * 1024;
+
+				Arena();
+				char* allocate(size_t size);
+				size_t get_allocations();
+				size_t get_blocks();
+		};
+
+	public:
+
+		/* This class stores the id and the fields selected by a projected search for one record
+		* The selected values are copied in to a buffer allocated from the arena of the search,
+		* and every row of a search shares the field layout. The arena is freed with the last row that uses it
+		*/
+		class Row
+		{
+			// This block defines variables for storing the row
+			private:
+				std::shared_ptr<const RowLayout> layout;
+				std::shared_ptr<Arena> arena;
+				const char* values;
+
+				const char* get_value(std::string name, int type);
+
+			// This block defines functions for reading the row
+			public:
+				Row(std::shared_ptr<const RowLayout> layout, std::shared_ptr<Arena> arena, unsigned int size, RecordView& record);
+				unsigned int get_id();
+				int get_int(std::string name);
+				float get_float(std::string name);
+				std::string get_char16(std::string name);
+		};
+
 		DB();
-		void create(std::string db_name, Table table);
+		~DB();
+		void create(std::string db_name, Table table, int layout = LAYOUT_ROWS);
 		void load(std::string db_name);
+		void close();
+		void upgrade();
 		void insert(Record record);
+		void insert_batch(const std::vector<Record>& records);
+		template <typename Iterator>
+		void insert_batch(Iterator first, Iterator last);
 		void update(Record record);
+		void insert(const FlatRecord& record);
+		void insert_batch(const std::vector<FlatRecord>& records);
+		void update(const FlatRecord& record);
+		std::shared_ptr<const Schema> get_schema();
 		std::vector<Record> search_int(std::string field, int value);
 		std::vector<Record> search_float(std::string field, float value);
 		std::vector<Record> search_char16(std::string field, std::string value);
+		std::vector<Record> search_int(const FieldHandle& field, int value);
+		std::vector<Record> search_float(const FieldHandle& field, float value);
+		std::vector<Record> search_char16(const FieldHandle& field, std::string value);
+		std::vector<Record> search(Predicate predicate);
+		unsigned int search(Predicate predicate, std::function<bool(RecordView&)> visitor, unsigned int limit = 0);
+		std::vector<Row> search(Predicate predicate, const std::vector<std::string>& fields);
+		unsigned int export_records(std::ostream& stream, int format, const std::vector<std::string>& fields = std::vector<std::string>());
+		unsigned int export_records(std::ostream& stream, int format, Predicate predicate,
+			const std::vector<std::string>& fields = std::vector<std::string>());
 		void remove(unsigned int id);
+		void create_index(std::string field);
+		void enable_hash_index(std::string field);
+		size_t get_hash_index_memory(std::string field);
+		double get_hash_index_build_time(std::string field);
+		void set_vectorized(bool vectorized);
+		void set_scan_threads(unsigned int threads);
+		void set_shared(bool shared);
+		void set_write_log(bool write_log);
+		void set_group_commit(unsigned int operations, unsigned int milliseconds);
+		void commit();
+		void set_cache_size(size_t size);
+		size_t get_cache_hits();
+		size_t get_cache_misses();
+		void set_compaction_threshold(double threshold);
+		void set_compaction_hook(std::function<void(int step)> hook);
+		void compact_now();
+		int compaction_status();
+		void wait_for_compaction();
 
 	private:
 
 		/* Initialize database metadata
 		* This information will be updated on database insert and load operations
+		* The record count is the number of record slots in the file, including the slots of removed records
 		*/
 		bool is_loaded;
 		Table table;
 		unsigned int record_count;
-		unsigned int removed_count;
 		std::string db_name;
+
+		/* Store the session state for the open database file
+		* The file stays open from create or load until close so record operations
+		* don't need to reopen it or re-read the header on every call
+		*/
+		std::fstream db_file;
+		unsigned int format_version;
+		std::streamoff table_offset;
+		unsigned int record_size;
+		bool header_dirty;
+		unsigned int header_state;
+		unsigned int layout;
+		unsigned int group_rows;
+		unsigned int generation;
+
+		/* Store the page cache for the database file
+		* Record reads and writes through the session stream go through the cache, while searches read the mapped file,
+		* so dirty pages are written back before the file is mapped, copied, shared with another session or closed
+		*/
+		PageCache page_cache;
+
+		void open_file(std::string db_filename);
+		void flush_file();
+		void write_format(std::ostream& stream, unsigned int format);
+		unsigned int read_format(std::istream& stream);
+		void write_header();
+		void write_header(std::ostream& stream, unsigned int format, unsigned int count, unsigned int size, unsigned int removed);
+		std::string build_header(unsigned int format, unsigned int count, unsigned int size, unsigned int removed);
+		bool read_header(unsigned int& removed, bool open_allowed);
+		unsigned int get_header_size(unsigned int format);
+		unsigned int get_header_checksum(const std::string& header);
+		void store_records(const std::string& buffer, unsigned int count);
+		void write_file(std::ostream& stream, std::streamoff position, const char* data, size_t size);
+		std::streamoff get_records_offset();
+
+		/* Locate record values in the record area of the file
+		* Row databases store each record contiguously, while columnar databases store the records in row groups
+		* of group_rows slots where each field of the group is stored contiguously in table order
+		*/
+		size_t get_records_size(unsigned int count);
+		size_t get_value_position(unsigned int slot, unsigned int offset, unsigned int size);
+		unsigned int get_value_stride(unsigned int size);
+		void read_slot(const char* records, unsigned int slot, char* record);
+		void read_slot(unsigned int slot, char* record);
+		void write_slots(std::ostream& stream, std::streamoff records_offset, unsigned int slot, const char* records, unsigned int count);
+		void pad_groups(std::ostream& stream, std::streamoff records_offset, unsigned int count);
+		void gather_field(const char* records, FixedString8 name, std::string& pairs);
+
+		/* Store the mapping from record ids to record slots in the file
+		* Ids are never reused, and the slots of removed records are kept in a free list so inserts can reuse them
+		* The mapping is saved to a side file when the database is closed, and rebuilt from the records if it is missing
+		*/
+		unsigned int next_id;
+		std::vector<unsigned int> id_slots;
+		std::vector<unsigned int> free_slots;
+
+		std::string get_ids_filename();
+		bool read_ids();
+		void write_ids();
+		void rebuild_ids(unsigned int min_next_id);
+		void read_slot_ids(unsigned int first, std::vector<unsigned int>& slot_ids);
+		unsigned int get_slot(unsigned int id);
+
+		/* Store the byte offset and size of each field value within a record
+		* The offsets are calculated once from the table layout when the database is created or loaded
+		*/
+		std::map<std::string, unsigned int> field_offsets;
+		std::map<std::string, unsigned int> field_sizes;
+		std::map<std::string, int> field_types;
+		std::shared_ptr<const Schema> schema;
+		bool vectorized;
+		unsigned int scan_threads;
+
+		/* Scans pass each matching record to a visitor as a view of the mapped file
+		* Scans shared between threads visit the records of each chunk on the thread that scanned it,
+		* after telling the caller how many chunks there are, and a visitor stops the scan by returning false
+		* The chunk count is always given under the database lock, and is 0 if nothing is scanned
+		*/
+		typedef std::function<void(unsigned int chunk_count)> ScanStart;
+		typedef std::function<bool(unsigned int chunk, RecordView& record)> ScanVisitor;
+
+		/* Store the field compared by a scan, resolved from the predicate once per search
+		* Predicates on a handle of the loaded schema take the type, offset and size from the handle,
+		* and other predicates look the field name up in the layout of the loaded file
+		*/
+		struct ScanField
+		{
+			std::string name;
+			int type;
+			unsigned int id_offset;
+			unsigned int offset;
+			unsigned int size;
+		};
+
+		void build_layout();
+		bool write_flat_record(std::string& buffer, const FlatRecord& record, unsigned int id);
+		std::shared_ptr<const RowLayout> build_row_layout(const std::vector<std::string>& fields, unsigned int& row_size);
+		std::vector<Record> scan(Predicate predicate);
+		void scan(Predicate predicate, unsigned int threads, const ScanStart& start, const ScanVisitor& visitor);
+		bool resolve_scan_field(Predicate& predicate, ScanField& field);
+		void scan_chunks(Predicate predicate, const ScanField& field, const char* mapped_records, std::atomic<unsigned int>& next_chunk,
+			unsigned int chunk_count, const ScanVisitor& visitor);
+		template <typename Result>
+		static std::vector<Result> join_chunks(std::vector<std::vector<Result> >& chunk_results);
+		std::vector<FieldHandle> get_export_fields(const std::vector<std::string>& fields);
+		void write_export_header(std::string& buffer, int format, const std::vector<FieldHandle>& fields);
+		void write_export_record(std::string& buffer, int format, const std::vector<FieldHandle>& fields, RecordView& record);
+
+		/* Store the open secondary indexes by field name
+		* Indexes are kept up to date by record operations and used by searches on their field
+		*/
+		std::map<std::string, Index> indexes;
+
+		std::string get_index_filename(FixedString8 name);
+		void open_indexes();
+		void build_index(FixedString8 name);
+		void update_indexes(const char* record, bool add);
+
+		/* Store the in-memory hash indexes by field name
+		* Hash indexes are enabled per field and built on the first equality search on the field,
+		* then kept up to date by record operations until the database is closed
+		*/
+		std::map<std::string, HashIndex> hash_indexes;
+
+		/* Store the locks that make the database safe to share between threads
+		* Searches and read-only getters hold the database lock shared, and every other operation holds the write mutex
+		* for the whole operation and the database lock exclusively while it changes the database, through a WriteLock
+		* Searches never take the write mutex, so they only wait for the database lock while a writer waits for it or holds it
+		* Writers hold the lock gate only while they wait for the database lock, and searches pass through the gate before
+		* taking the lock shared, so a waiting writer isn't starved by a steady stream of searches, and searches that start
+		* while it waits queue behind it
+		* Searches take the search mutex around the state they still share, which is the session stream buffer,
+		* the page cache when it is flushed, and the B+-tree index streams and hash indexes that are built on the first search
+		*/
+		std::shared_timed_mutex db_mutex;
+		std::mutex write_mutex;
+		std::mutex lock_gate;
+		std::mutex search_mutex;
+
+		/* Store the locks that make the database safe to share between processes
+		* Sessions hold the session lock shared while the database is open, so the last session to close can tell
+		* that it is the last one, and hold the file lock around every operation
+		* Only databases in the current file format are shared, since older record headers have no generation
+		* Searches running at the same time share one handle on the database file for the search lock,
+		* which the first search locks shared and the last one unlocks
+		*/
+		bool shared;
+		bool session_shared;
+		FileLock file_lock;
+		FileLock session_lock;
+		FileLock search_file_lock;
+		unsigned int search_file_count;
+		std::mutex search_file_mutex;
+
+		/* Store the change journal that sessions sharing the file catch up with each other from
+		* Every operation appends the slot, old id and new id of each existing slot it wrote to a side file,
+		* and sessions read the entries appended since their last operation instead of reading every record again
+		* Slots appended after the last record are read from the file, and the journal is emptied when the file is replaced
+		*/
+		LogFile change_file;
+		size_t change_offset;
+		std::string change_entries;
+
+		std::string get_lock_filename();
+		std::string get_changes_filename();
+		bool open_session();
+		void lock_file();
+		bool finish_operation();
+		void unlock_file();
+		void refresh_session();
+		bool read_changes(unsigned int previous_count);
+		void mark_slot_changed(unsigned int slot, unsigned int old_id, unsigned int new_id);
+		bool lock_search(bool& stale);
+		void unlock_search();
+		bool read_generation(FileLock& lock, unsigned int& stored_generation);
+
+		/* This class holds the write mutex and the database lock exclusively while it is in scope
+		* Writers take the write mutex first, so they run one at a time, and shared sessions then wait for the file lock
+		* before taking the database lock, so searches aren't held up while another process has the file
+		* When the operation ends, a write-ahead log sync that completes a group is made after the database lock is released
+		*/
+		class WriteLock
+		{
+			private:
+				DB& db;
+				bool locked;
+
+			public:
+				WriteLock(DB& db) : db(db), locked(false)
+				{
+					lock();
+				}
+
+				~WriteLock()
+				{
+					if (locked)
+						unlock();
+				}
+
+				void lock()
+				{
+					db.write_mutex.lock();
+					db.lock_file();
+					db.lock_gate.lock();
+					db.db_mutex.lock();
+					db.lock_gate.unlock();
+					db.refresh_session();
+					locked = true;
+				}
+
+				void unlock()
+				{
+					bool sync = db.finish_operation();
+					db.unlock_file();
+					db.db_mutex.unlock();
+					if (sync)
+						db.sync_log();
+					db.write_mutex.unlock();
+					locked = false;
+				}
+		};
+
+		// This class holds the search lock of a shared session from a successful lock until it is out of scope
+		class SearchLock
+		{
+			private:
+				DB& db;
+				bool locked;
+
+			public:
+				SearchLock(DB& db) : db(db), locked(false)
+				{
+				}
+
+				~SearchLock()
+				{
+					if (locked)
+						db.unlock_search();
+				}
+
+				bool lock(bool& stale)
+				{
+					locked = db.lock_search(stale);
+					return locked;
+				}
+		};
+
+		/* Store the state of background compaction
+		* Record operations hold the database lock, and the compaction worker only takes it to start and to finish
+		* Slots written while the worker copies are marked so the worker can copy them again before the swap
+		* Every slot is marked when another session changed the file, and the copy is dropped if it replaced the file
+		* The worker thread object is only joined or replaced with the thread mutex held, since callers can wait from any thread
+		*/
+		std::thread compaction_thread;
+		std::mutex compaction_thread_mutex;
+		std::atomic<bool> compaction_running;
+		std::vector<bool> compaction_changed;
+		bool compaction_replaced;
+		double compaction_threshold;
+
+		/* Store the function compaction calls after each step of replacing the database file, for fault injection tests
+		* It runs on the compaction worker with the database lock held, so it must not use the database
+		*/
+		std::function<void(int step)> compaction_hook;
+
+		void report_compaction_step(int step);
+
+		/* Store the state of the write-ahead log
+		* The writes each operation makes to the database file are collected, appended to the log as one checksummed entry
+		* and then applied to the page cache, where their pages are held until the log is synced past the entry,
+		* so no change reaches the database file before the log entry describing it is on the disk
+		* Entries are numbered in the order they are appended, and the log worker or the operation that completes a group
+		* records the number of the last entry each sync covered
+		* The log is synced once per group of operations, and checkpointed by the log worker, which syncs the database file
+		* and empties the log, once it grows large
+		*/
+		bool write_log;
+		LogFile log_file;
+		std::string log_writes;
+		std::atomic<unsigned int> log_unsynced;
+		std::atomic<uint64_t> log_sequence;
+		std::atomic<uint64_t> log_synced;
+		unsigned int commit_operations;
+		std::atomic<unsigned int> commit_interval;
+		std::thread log_thread;
+		std::mutex log_mutex;
+		std::condition_variable log_wake;
+		bool log_stopping;
+
+		std::string get_log_filename();
+		void open_log();
+		bool replay_log();
+		void apply_log(const std::string& writes, uint64_t sequence);
+		void sync_log();
+		void checkpoint_log();
+		void close_log(bool last_session);
+		void sync_db_file();
+		void sync_file(std::string filename);
+		void run_log();
+		void stop_log();
+
+		void close_file();
+		void start_compaction();
+		void compact();
 };
 
+/* This API function inserts a range of records in the database
+* The records are serialized in to one buffer, and the records that don't fill the slots of removed records
+* are appended with a single write. The header is marked as changed and written out like it is for a single insert
+*/
+template <typename Iterator>
+void DB::insert_batch(Iterator first, Iterator last)
+{
+	WriteLock lock(*this);
+
+	if (! db_file.is_open())
+		return;
+
+	// Assign consecutive ids and serialize each sanitized record in to the buffer
+	std::ostringstream buffer;
+	unsigned int count = 0;
+	for (; first != last; ++first)
+	{
+		Record record = *first;
+		record.sanitize();
+
+		record.set_id(next_id + count);
+		record.write(buffer, format_version);
+		count++;
+	}
+
+	store_records(buffer.str(), count);
+}
+
+/* This function joins the results collected by each scan chunk in chunk order
+* The results are moved out of the chunks in to a vector sized once for all of them
+*/
+template <typename Result>
+std::vector<Result> DB::join_chunks(std::vector<std::vector<Result> >& chunk_results)
+{
+	if (chunk_results.size() == 1)
+		return std::move(chunk_results[0]);
+
+	size_t count = 0;
+	for (size_t i = 0; i < chunk_results.size(); i++)
+		count += chunk_results[i].size();
+
+	std::vector<Result> results;
+	results.reserve(count);
+	for (size_t i = 0; i < chunk_results.size(); i++)
+		results.insert(results.end(), std::make_move_iterator(chunk_results[i].begin()), std::make_move_iterator(chunk_results[i].end()));
+
+	return results;
+}
+
 #endif
@@ -22,7 +22,7 @@ DB::Field::Field(unsigned int size)
 }
 
 // This function writes field information to disk using a stream object
-void DB::Field::write(std::fstream& stream)
+void DB::Field::write(std::ostream& stream)
 {	
 	// Write out the field properties
 	stream.write(name.get().c_str(), name.get_size());
@@ -30,7 +30,7 @@ void DB::Field::write(std::fstream& stream)
 }
 
 // This function reads field information from disk using a stream object
-void DB::Field::read(std::fstream& stream)
+void DB::Field::read(std::istream& stream)
 {	
 	// Read the field properties
 	name.read(stream);
@@ -59,19 +59,19 @@ void DB::Field::set_type(int type)
 }
 
 // This getter gets the field size
-unsigned int DB::Field::get_size()
+unsigned int DB::Field::get_size() const
 {
 	return size;
 }
 
 // This getter gets the field name
-DB::FixedString8 DB::Field::get_name()
+DB::FixedString8 DB::Field::get_name() const
 {
 	return name;
 }
 
 // This getter gets the field type
-int DB::Field::get_type()
+int DB::Field::get_type() const
 {
 	return type;
 }
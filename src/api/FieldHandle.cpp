@@ -0,0 +1,63 @@
+/* This file contains function definitions for the FieldHandle class
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+// This constructor creates a handle that matches no field
+DB::FieldHandle::FieldHandle()
+{
+	type = ATTR_NONE;
+	index = 0;
+	offset = 0;
+	size = 0;
+}
+
+// This constructor creates a handle for a field of a compiled schema, the name is already normalized
+DB::FieldHandle::FieldHandle(std::string name, int type, unsigned int index, unsigned int offset, unsigned int size)
+	: name(name), type(type), index(index), offset(offset), size(size)
+{
+}
+
+// This function returns whether the handle was found in a schema
+bool DB::FieldHandle::is_valid() const
+{
+	return type != ATTR_NONE;
+}
+
+// This getter returns the normalized field name
+const std::string& DB::FieldHandle::get_name() const
+{
+	return name;
+}
+
+// This getter returns the field type
+int DB::FieldHandle::get_type() const
+{
+	return type;
+}
+
+// This getter returns the position of the field in the schema, where the id is 0
+unsigned int DB::FieldHandle::get_index() const
+{
+	return index;
+}
+
+// This getter returns the byte offset of the field in a serialized record
+unsigned int DB::FieldHandle::get_offset() const
+{
+	return offset;
+}
+
+// This getter returns the size of the field in bytes
+unsigned int DB::FieldHandle::get_size() const
+{
+	return size;
+}
+
+// This function returns whether another handle is for the same field at the same place in a record
+bool DB::FieldHandle::matches(const DB::FieldHandle& field) const
+{
+	return type == field.type && index == field.index && offset == field.offset && size == field.size && name == field.name;
+}
@@ -0,0 +1,186 @@
+/* This file contains function definitions for the FileLock class
+* On POSIX systems files are locked with flock, on Windows a byte range past the end of any database file is locked
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+#ifndef _WIN32
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#else
+#include <windows.h>
+#endif
+
+// This constructor initializes a closed lock
+DB::FileLock::FileLock()
+{
+	handle = -1;
+	locked = false;
+}
+
+// This destructor releases the lock and closes the file
+DB::FileLock::~FileLock()
+{
+	close();
+}
+
+/* This function opens a file to lock, creating it if it doesn't exist
+* Returns false if the file can't be opened
+*/
+bool DB::FileLock::open(std::string filename)
+{
+	close();
+
+#ifndef _WIN32
+	int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return false;
+
+	handle = fd;
+#else
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	handle = (intptr_t) file;
+#endif
+
+	this -> filename = filename;
+	return true;
+}
+
+/* This function locks the file, shared or exclusively
+* If wait is false it returns false instead of waiting for a lock held by another session
+* Changing the mode of a held lock releases it first, so callers serialize mode changes with another lock
+*/
+bool DB::FileLock::lock(bool exclusive, bool wait)
+{
+	if (handle == -1)
+		return false;
+
+	unlock();
+
+#ifndef _WIN32
+	int operation = (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB);
+	int result;
+	do
+	{
+		result = flock((int) handle, operation);
+	}
+	while (result != 0 && errno == EINTR);
+
+	if (result != 0)
+		return false;
+#else
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.OffsetHigh = 0x7FFFFFFF;
+
+	DWORD flags = (exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0) | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+	if (! LockFileEx((HANDLE) handle, flags, 0, 1, 0, &overlapped))
+		return false;
+#endif
+
+	locked = true;
+	return true;
+}
+
+// This function releases the lock if it is held
+void DB::FileLock::unlock()
+{
+	if (! locked)
+		return;
+
+#ifndef _WIN32
+	flock((int) handle, LOCK_UN);
+#else
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.OffsetHigh = 0x7FFFFFFF;
+	UnlockFileEx((HANDLE) handle, 0, 1, 0, &overlapped);
+#endif
+
+	locked = false;
+}
+
+/* This function reads bytes from a position in the file without moving any stream
+* Returns false if the bytes can't all be read
+*/
+bool DB::FileLock::read(std::streamoff offset, char* data, size_t size)
+{
+	if (handle == -1)
+		return false;
+
+#ifndef _WIN32
+	return pread((int) handle, data, size, offset) == (ssize_t) size;
+#else
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.Offset = (DWORD) offset;
+	overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+	DWORD read_size = 0;
+	return ReadFile((HANDLE) handle, data, (DWORD) size, &read_size, &overlapped) && read_size == size;
+#endif
+}
+
+/* This function checks whether the file name now refers to a different file than the open file
+* This happens when another session replaces the file, and a missing file isn't counted as replaced
+*/
+bool DB::FileLock::is_replaced()
+{
+	if (handle == -1)
+		return false;
+
+#ifndef _WIN32
+	struct stat open_stat;
+	struct stat name_stat;
+	if (fstat((int) handle, &open_stat) != 0 || stat(filename.c_str(), &name_stat) != 0)
+		return false;
+
+	return open_stat.st_dev != name_stat.st_dev || open_stat.st_ino != name_stat.st_ino;
+#else
+	HANDLE file = CreateFileA(filename.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	BY_HANDLE_FILE_INFORMATION open_info;
+	BY_HANDLE_FILE_INFORMATION name_info;
+	bool replaced = GetFileInformationByHandle((HANDLE) handle, &open_info) && GetFileInformationByHandle(file, &name_info)
+		&& (open_info.dwVolumeSerialNumber != name_info.dwVolumeSerialNumber || open_info.nFileIndexHigh != name_info.nFileIndexHigh
+		|| open_info.nFileIndexLow != name_info.nFileIndexLow);
+	CloseHandle(file);
+
+	return replaced;
+#endif
+}
+
+// This function releases the lock and closes the file
+void DB::FileLock::close()
+{
+	if (handle == -1)
+		return;
+
+	unlock();
+
+#ifndef _WIN32
+	::close((int) handle);
+#else
+	CloseHandle((HANDLE) handle);
+#endif
+
+	handle = -1;
+}
+
+// This function returns whether a file is open
+bool DB::FileLock::is_open()
+{
+	return handle != -1;
+}
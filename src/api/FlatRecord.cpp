@@ -0,0 +1,134 @@
+/* This file contains function definitions for the FlatRecord class
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+// This constructor creates a record with every field unset, allocating the value buffer once
+DB::FlatRecord::FlatRecord(std::shared_ptr<const DB::Schema> schema) : schema(schema), values(schema -> get_record_size(), '\0')
+{
+	const std::vector<FieldHandle>& fields = schema -> get_fields();
+	for (size_t i = 0; i < fields.size(); i++)
+	{
+		if (fields[i].get_type() == ATTR_CHAR16)
+			memset(&values[fields[i].get_offset()], ' ', fields[i].get_size());
+	}
+}
+
+// This constructor creates a record from the serialized values of a record in the schema layout
+DB::FlatRecord::FlatRecord(std::shared_ptr<const DB::Schema> schema, const char* values)
+	: schema(schema), values(values, schema -> get_record_size())
+{
+}
+
+// This setter sets the record id
+void DB::FlatRecord::set_id(unsigned int id)
+{
+	memcpy(&values[0], &id, sizeof(unsigned int));
+}
+
+// This setter sets the value of an integer field, and does nothing if the field isn't an integer field
+void DB::FlatRecord::set_int(const DB::FieldHandle& field, int data)
+{
+	char* value = get_value(field, ATTR_INT);
+	if (value != NULL)
+		memcpy(value, &data, sizeof(int));
+}
+
+// This setter sets the value of a floating point field, and does nothing if the field isn't a floating point field
+void DB::FlatRecord::set_float(const DB::FieldHandle& field, float data)
+{
+	char* value = get_value(field, ATTR_FLOAT);
+	if (value != NULL)
+		memcpy(value, &data, sizeof(float));
+}
+
+/* This setter sets the value of a character field, and does nothing if the field isn't a character field
+* The value is truncated or padded with spaces to the field size like a FixedString16
+*/
+void DB::FlatRecord::set_char16(const DB::FieldHandle& field, std::string data)
+{
+	char* value = get_value(field, ATTR_CHAR16);
+	if (value == NULL)
+		return;
+
+	size_t size = field.get_size();
+	size_t length = std::min(data.size(), size);
+	memcpy(value, data.data(), length);
+	memset(value + length, ' ', size - length);
+}
+
+// This getter returns the record id
+unsigned int DB::FlatRecord::get_id()
+{
+	unsigned int id;
+	memcpy(&id, &values[0], sizeof(unsigned int));
+	return id;
+}
+
+// This getter returns the value of an integer field, or 0 if the field isn't an integer field
+int DB::FlatRecord::get_int(const DB::FieldHandle& field)
+{
+	int data = 0;
+	char* value = get_value(field, ATTR_INT);
+	if (value != NULL)
+		memcpy(&data, value, sizeof(int));
+
+	return data;
+}
+
+// This getter returns the value of a floating point field, or 0 if the field isn't a floating point field
+float DB::FlatRecord::get_float(const DB::FieldHandle& field)
+{
+	float data = 0;
+	char* value = get_value(field, ATTR_FLOAT);
+	if (value != NULL)
+		memcpy(&data, value, sizeof(float));
+
+	return data;
+}
+
+// This getter returns the value of a character field, or an empty string if the field isn't a character field
+std::string DB::FlatRecord::get_char16(const DB::FieldHandle& field)
+{
+	char* value = get_value(field, ATTR_CHAR16);
+	if (value == NULL)
+		return "";
+
+	return std::string(value, field.get_size());
+}
+
+// This getter returns the schema the record is laid out in
+std::shared_ptr<const DB::Schema> DB::FlatRecord::get_schema() const
+{
+	return schema;
+}
+
+// This getter returns the serialized values of the record
+const std::string& DB::FlatRecord::get_values() const
+{
+	return values;
+}
+
+// This function converts the record to a Record object
+DB::Record DB::FlatRecord::get_record() const
+{
+	std::istringstream record_stream(values);
+
+	Record record;
+	record.set_table(schema -> get_table());
+	record.read(record_stream, FORMAT_CURRENT);
+	return record;
+}
+
+/* This function returns the address of a field value, or NULL if the handle has another type
+* Handles are expected to come from the record's schema, but one that doesn't fit in the record is never used
+*/
+char* DB::FlatRecord::get_value(const DB::FieldHandle& field, int type)
+{
+	if (field.get_type() != type || field.get_offset() + field.get_size() > values.size())
+		return NULL;
+
+	return &values[field.get_offset()];
+}
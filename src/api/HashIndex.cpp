@@ -0,0 +1,245 @@
+/* This file contains function definitions for the HashIndex class
+* The hash index lives only in memory and is rebuilt from the records when it is needed
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+#include <chrono>
+
+// Define the state of each slot in the hash table
+const char DB::HashIndex::SLOT_EMPTY;
+const char DB::HashIndex::SLOT_USED;
+const char DB::HashIndex::SLOT_DELETED;
+
+// Define the number of slots in a new hash table
+static const size_t INITIAL_CAPACITY = 16;
+
+// This constructor initializes an empty hash index that hasn't been built yet
+DB::HashIndex::HashIndex()
+{
+	type = ATTR_INT;
+	key_size = sizeof(int);
+	build_time = 0;
+	clear();
+}
+
+// This function builds the hash index from a block of records, skipping records marked as removed
+void DB::HashIndex::build(int type, const char* records, unsigned int count, unsigned int record_size,
+	unsigned int id_offset, unsigned int value_offset)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	clear();
+	this -> type = type;
+	key_size = type == ATTR_CHAR16 ? AttrChar16().get_size() : sizeof(int);
+	resize(INITIAL_CAPACITY);
+
+	for (unsigned int i = 0; i < count; i++, records += record_size)
+	{
+		unsigned int id;
+		memcpy(&id, records + id_offset, sizeof(unsigned int));
+
+		if (id != 0)
+			insert(records + value_offset, id);
+	}
+
+	built = true;
+
+	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+	build_time = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// This function releases the hash table and marks the index as not built
+void DB::HashIndex::clear()
+{
+	built = false;
+	used_count = 0;
+	deleted_count = 0;
+	std::vector<char>().swap(keys);
+	std::vector<char>().swap(states);
+	std::vector<std::vector<unsigned int> >().swap(postings);
+}
+
+// This function returns whether the hash index has been built
+bool DB::HashIndex::is_built()
+{
+	return built;
+}
+
+// This function adds a record id to the list for its field value
+void DB::HashIndex::insert(const char* value, unsigned int id)
+{
+	// Grow the table to keep it at most half full, counting deleted slots since they lengthen probes
+	if ((used_count + deleted_count + 1) * 2 > states.size())
+		resize(states.size() * 2);
+
+	std::string key = normalize(value);
+	size_t slot = find_slot(key, true);
+
+	if (states[slot] != SLOT_USED)
+	{
+		if (states[slot] == SLOT_DELETED)
+			deleted_count--;
+
+		memcpy(&keys[slot * key_size], key.data(), key_size);
+		states[slot] = SLOT_USED;
+		used_count++;
+	}
+
+	postings[slot].push_back(id);
+}
+
+/* This function removes a record id from the list for its field value
+* The slot is marked as deleted once no records contain the value
+*/
+void DB::HashIndex::remove(const char* value, unsigned int id)
+{
+	if (states.empty())
+		return;
+
+	size_t slot = find_slot(normalize(value), false);
+	if (slot == states.size())
+		return;
+
+	std::vector<unsigned int>& ids = postings[slot];
+	std::vector<unsigned int>::iterator it = std::find(ids.begin(), ids.end(), id);
+	if (it == ids.end())
+		return;
+
+	*it = ids.back();
+	ids.pop_back();
+
+	if (ids.empty())
+	{
+		std::vector<unsigned int>().swap(ids);
+		states[slot] = SLOT_DELETED;
+		used_count--;
+		deleted_count++;
+	}
+}
+
+// This function returns the ids of the records that contain a field value
+std::vector<unsigned int> DB::HashIndex::search(const char* value)
+{
+	if (states.empty())
+		return std::vector<unsigned int>();
+
+	size_t slot = find_slot(normalize(value), false);
+	if (slot == states.size())
+		return std::vector<unsigned int>();
+
+	return postings[slot];
+}
+
+// This function returns an estimate of the memory used by the hash table and id lists in bytes
+size_t DB::HashIndex::get_memory_usage()
+{
+	size_t memory = keys.capacity() + states.capacity() + postings.capacity() * sizeof(std::vector<unsigned int>);
+
+	for (size_t i = 0; i < postings.size(); i++)
+		memory += postings[i].capacity() * sizeof(unsigned int);
+
+	return memory;
+}
+
+// This function returns the time taken by the last build in milliseconds
+double DB::HashIndex::get_build_time()
+{
+	return build_time;
+}
+
+/* This function copies a stored field value as a hash key
+* Negative zero floats are stored as positive zero so both match equality searches
+*/
+std::string DB::HashIndex::normalize(const char* value)
+{
+	std::string key(value, key_size);
+
+	if (type == ATTR_FLOAT)
+	{
+		float data;
+		memcpy(&data, value, sizeof(float));
+
+		if (data == 0)
+		{
+			data = 0;
+			memcpy(&key[0], &data, sizeof(float));
+		}
+	}
+
+	return key;
+}
+
+/* This function finds the slot for a key using linear probing
+* When searching, it returns the slot holding the key or the table size if the key isn't found
+* When inserting, it returns the slot holding the key or the first free slot on the probe path
+*/
+size_t DB::HashIndex::find_slot(const std::string& key, bool inserting)
+{
+	// Hash the key bytes with FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < key.size(); i++)
+	{
+		hash ^= (unsigned char) key[i];
+		hash *= 1099511628211ULL;
+	}
+
+	size_t mask = states.size() - 1;
+	size_t free_slot = states.size();
+
+	for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+	{
+		if (states[slot] == SLOT_EMPTY)
+		{
+			if (! inserting)
+				return states.size();
+
+			return free_slot != states.size() ? free_slot : slot;
+		}
+
+		if (states[slot] == SLOT_DELETED)
+		{
+			if (free_slot == states.size())
+				free_slot = slot;
+		}
+		else if (memcmp(&keys[slot * key_size], key.data(), key_size) == 0)
+		{
+			return slot;
+		}
+	}
+}
+
+/* This function rehashes the used slots in to a table with at least the given capacity
+* Deleted slots are dropped, so the table may stay the same size when many values were removed
+*/
+void DB::HashIndex::resize(size_t capacity)
+{
+	while (capacity > INITIAL_CAPACITY && used_count * 4 < capacity)
+		capacity /= 2;
+	if (capacity < INITIAL_CAPACITY)
+		capacity = INITIAL_CAPACITY;
+
+	std::vector<char> old_keys;
+	std::vector<char> old_states;
+	std::vector<std::vector<unsigned int> > old_postings;
+	old_keys.swap(keys);
+	old_states.swap(states);
+	old_postings.swap(postings);
+
+	keys.assign(capacity * key_size, 0);
+	states.assign(capacity, SLOT_EMPTY);
+	postings.resize(capacity);
+	deleted_count = 0;
+
+	for (size_t i = 0; i < old_states.size(); i++)
+	{
+		if (old_states[i] != SLOT_USED)
+			continue;
+
+		size_t slot = find_slot(std::string(&old_keys[i * key_size], key_size), true);
+		memcpy(&keys[slot * key_size], &old_keys[i * key_size], key_size);
+		states[slot] = SLOT_USED;
+		postings[slot].swap(old_postings[i]);
+	}
+}
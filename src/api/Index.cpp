@@ -0,0 +1,470 @@
+/* This file contains function definitions for the Index class
+* The index is a B+-tree stored in fixed-size pages, with leaves linked in key order for range searches
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+// Define the size of each index page
+const unsigned int DB::Index::PAGE_SIZE;
+
+/* Define the size of the header at the start of each node page
+* The header stores whether the node is a leaf, the number of entries, and the next leaf page
+*/
+static const unsigned int NODE_HEADER_SIZE = 3 * sizeof(unsigned int);
+
+// This function writes an unsigned integer in big-endian byte order so encoded entries compare with memcmp
+static void put_big_endian(std::string& buffer, uint32_t value)
+{
+	buffer.push_back((char) (value >> 24));
+	buffer.push_back((char) (value >> 16));
+	buffer.push_back((char) (value >> 8));
+	buffer.push_back((char) value);
+}
+
+// This function reads an unsigned integer in big-endian byte order
+static uint32_t get_big_endian(const std::string& buffer, size_t offset)
+{
+	return ((uint32_t) (unsigned char) buffer[offset] << 24) | ((uint32_t) (unsigned char) buffer[offset + 1] << 16)
+		| ((uint32_t) (unsigned char) buffer[offset + 2] << 8) | (uint32_t) (unsigned char) buffer[offset + 3];
+}
+
+// This constructor initializes an index that isn't backed by a file yet
+DB::Index::Index()
+{
+	type = ATTR_INT;
+	key_size = 0;
+	root = 0;
+	page_count = 0;
+}
+
+/* This function opens an existing index file and reads its metadata
+* It returns false if the file doesn't exist or isn't an index file
+*/
+bool DB::Index::open(std::string filename)
+{
+	close();
+
+	index_file.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	if (! index_file.is_open())
+		return false;
+
+	std::string magic;
+	magic.resize(INDEX_MAGIC.size());
+	index_file.read(&magic[0], INDEX_MAGIC.size());
+	index_file.read((char*)&type, sizeof(int));
+	index_file.read((char*)&key_size, sizeof(unsigned int));
+	index_file.read((char*)&root, sizeof(unsigned int));
+	index_file.read((char*)&page_count, sizeof(unsigned int));
+
+	if (! index_file || magic != INDEX_MAGIC)
+	{
+		index_file.close();
+		return false;
+	}
+
+	return true;
+}
+
+/* This function builds a new index file from a block of records
+* The entries for live records are sorted and packed in to full leaves,
+* then each level of internal nodes is built on top until a single root remains
+*/
+void DB::Index::build(std::string filename, int type, const char* records, unsigned int count, unsigned int record_size,
+	unsigned int id_offset, unsigned int value_offset)
+{
+	close();
+
+	this -> type = type;
+	key_size = type == ATTR_CHAR16 ? AttrChar16().get_size() : sizeof(int);
+	page_count = 1;
+
+	index_file.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+	if (! index_file.is_open())
+		return;
+
+	// Collect and sort the entries for every live record
+	std::vector<std::string> entries;
+	for (unsigned int i = 0; i < count; i++, records += record_size)
+	{
+		unsigned int id;
+		memcpy(&id, records + id_offset, sizeof(unsigned int));
+
+		if (id != 0)
+			entries.push_back(encode(records + value_offset, id));
+	}
+
+	std::sort(entries.begin(), entries.end());
+
+	// Pack the entries in to leaves, remembering the first entry and page of each node on the level
+	std::vector<std::string> level_entries;
+	std::vector<unsigned int> level_pages;
+	unsigned int leaf_capacity = get_leaf_capacity();
+	size_t position = 0;
+
+	do
+	{
+		Node leaf;
+		leaf.leaf = true;
+		leaf.next = 0;
+
+		size_t end = std::min(entries.size(), position + leaf_capacity);
+		leaf.entries.assign(entries.begin() + position, entries.begin() + end);
+		position = end;
+
+		unsigned int page = page_count++;
+		if (position < entries.size())
+			leaf.next = page_count;
+
+		write_node(page, leaf);
+		level_entries.push_back(leaf.entries.empty() ? std::string() : leaf.entries[0]);
+		level_pages.push_back(page);
+	}
+	while (position < entries.size());
+
+	// Build internal levels until there is only one node left to use as the root
+	unsigned int internal_capacity = get_internal_capacity();
+	while (level_pages.size() > 1)
+	{
+		std::vector<std::string> next_entries;
+		std::vector<unsigned int> next_pages;
+
+		for (size_t first = 0; first < level_pages.size(); first += internal_capacity + 1)
+		{
+			Node node;
+			node.leaf = false;
+			node.next = 0;
+
+			size_t last = std::min(level_pages.size(), first + internal_capacity + 1);
+			node.children.assign(level_pages.begin() + first, level_pages.begin() + last);
+			node.entries.assign(level_entries.begin() + first + 1, level_entries.begin() + last);
+
+			unsigned int page = page_count++;
+			write_node(page, node);
+			next_entries.push_back(level_entries[first]);
+			next_pages.push_back(page);
+		}
+
+		level_entries.swap(next_entries);
+		level_pages.swap(next_pages);
+	}
+
+	root = level_pages[0];
+	write_meta();
+}
+
+// This function adds an entry for a record to the index, splitting nodes that become full
+void DB::Index::insert(const char* value, unsigned int id)
+{
+	if (! index_file.is_open())
+		return;
+
+	std::string entry = encode(value, id);
+
+	// Walk down to the leaf that should contain the entry, remembering the path
+	std::vector<unsigned int> path;
+	std::vector<Node> path_nodes;
+	unsigned int page = root;
+	Node node;
+	read_node(page, node);
+
+	while (! node.leaf)
+	{
+		size_t child = std::upper_bound(node.entries.begin(), node.entries.end(), entry) - node.entries.begin();
+		path.push_back(page);
+		path_nodes.push_back(node);
+		page = node.children[child];
+		read_node(page, node);
+	}
+
+	// Add the entry to the leaf in order
+	std::vector<std::string>::iterator it = std::lower_bound(node.entries.begin(), node.entries.end(), entry);
+	if (it != node.entries.end() && *it == entry)
+		return;
+
+	node.entries.insert(it, entry);
+	if (node.entries.size() <= get_leaf_capacity())
+	{
+		write_node(page, node);
+		return;
+	}
+
+	// Split the full leaf, moving the upper half of its entries to a new leaf
+	Node right;
+	right.leaf = true;
+	right.next = node.next;
+	size_t middle = node.entries.size() / 2;
+	right.entries.assign(node.entries.begin() + middle, node.entries.end());
+	node.entries.resize(middle);
+
+	unsigned int right_page = page_count++;
+	node.next = right_page;
+	write_node(page, node);
+	write_node(right_page, right);
+	std::string separator = right.entries[0];
+
+	// Add the separator to each parent, splitting parents that become full
+	while (! path.empty())
+	{
+		unsigned int parent_page = path.back();
+		Node parent = path_nodes.back();
+		path.pop_back();
+		path_nodes.pop_back();
+
+		size_t position = std::upper_bound(parent.entries.begin(), parent.entries.end(), separator) - parent.entries.begin();
+		parent.entries.insert(parent.entries.begin() + position, separator);
+		parent.children.insert(parent.children.begin() + position + 1, right_page);
+
+		if (parent.entries.size() <= get_internal_capacity())
+		{
+			write_node(parent_page, parent);
+			write_meta();
+			return;
+		}
+
+		// The middle separator moves up to the next parent
+		Node parent_right;
+		parent_right.leaf = false;
+		parent_right.next = 0;
+		middle = parent.entries.size() / 2;
+		separator = parent.entries[middle];
+		parent_right.entries.assign(parent.entries.begin() + middle + 1, parent.entries.end());
+		parent_right.children.assign(parent.children.begin() + middle + 1, parent.children.end());
+		parent.entries.resize(middle);
+		parent.children.resize(middle + 1);
+
+		right_page = page_count++;
+		write_node(parent_page, parent);
+		write_node(right_page, parent_right);
+	}
+
+	// The root was split, so add a new root above it
+	Node new_root;
+	new_root.leaf = false;
+	new_root.next = 0;
+	new_root.entries.push_back(separator);
+	new_root.children.push_back(root);
+	new_root.children.push_back(right_page);
+
+	root = page_count++;
+	write_node(root, new_root);
+	write_meta();
+}
+
+/* This function removes the entry for a record from the index
+* Leaves are not merged when they become sparse, range searches skip empty leaves
+*/
+void DB::Index::remove(const char* value, unsigned int id)
+{
+	if (! index_file.is_open())
+		return;
+
+	std::string entry = encode(value, id);
+
+	unsigned int page = root;
+	Node node;
+	read_node(page, node);
+
+	while (! node.leaf)
+	{
+		size_t child = std::upper_bound(node.entries.begin(), node.entries.end(), entry) - node.entries.begin();
+		page = node.children[child];
+		read_node(page, node);
+	}
+
+	std::vector<std::string>::iterator it = std::lower_bound(node.entries.begin(), node.entries.end(), entry);
+	if (it == node.entries.end() || *it != entry)
+		return;
+
+	node.entries.erase(it);
+	write_node(page, node);
+}
+
+/* This function returns the ids of records with values in the inclusive range low to high
+* The ids are returned in value order
+*/
+std::vector<unsigned int> DB::Index::search(const char* low, const char* high)
+{
+	std::vector<unsigned int> ids;
+
+	if (! index_file.is_open())
+		return ids;
+
+	// The lowest and highest possible ids bound the entries for the range values
+	std::string low_entry = encode(low, 0);
+	std::string high_entry = encode(high, 0xFFFFFFFF);
+	if (low_entry > high_entry)
+		return ids;
+
+	unsigned int page = root;
+	Node node;
+	read_node(page, node);
+
+	while (! node.leaf)
+	{
+		size_t child = std::upper_bound(node.entries.begin(), node.entries.end(), low_entry) - node.entries.begin();
+		page = node.children[child];
+		read_node(page, node);
+	}
+
+	// Walk the linked leaves from the first entry in range until an entry past the range is found
+	std::vector<std::string>::iterator it = std::lower_bound(node.entries.begin(), node.entries.end(), low_entry);
+	while (true)
+	{
+		for (; it != node.entries.end(); it++)
+		{
+			if (*it > high_entry)
+				return ids;
+
+			ids.push_back(get_big_endian(*it, key_size));
+		}
+
+		if (node.next == 0)
+			return ids;
+
+		read_node(node.next, node);
+		it = node.entries.begin();
+	}
+}
+
+// This function writes any buffered changes to the index file
+void DB::Index::flush()
+{
+	if (index_file.is_open())
+		index_file.flush();
+}
+
+// This function closes the index file
+void DB::Index::close()
+{
+	if (index_file.is_open())
+		index_file.close();
+}
+
+/* This function encodes a stored field value and record id as an index entry
+* Integers have their sign bit flipped and floats are mapped so their bits sort in value order,
+* then both are written big-endian so entries compare correctly byte by byte
+*/
+std::string DB::Index::encode(const char* value, unsigned int id)
+{
+	std::string entry;
+
+	if (type == ATTR_CHAR16)
+	{
+		entry.assign(value, key_size);
+	}
+	else if (type == ATTR_FLOAT)
+	{
+		float data;
+		uint32_t bits;
+		memcpy(&data, value, sizeof(float));
+
+		// Negative zero is stored as positive zero so both match equality searches
+		if (data == 0)
+			data = 0;
+		memcpy(&bits, &data, sizeof(uint32_t));
+
+		bits = (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+		put_big_endian(entry, bits);
+	}
+	else
+	{
+		uint32_t bits;
+		memcpy(&bits, value, sizeof(uint32_t));
+		put_big_endian(entry, bits ^ 0x80000000);
+	}
+
+	put_big_endian(entry, id);
+	return entry;
+}
+
+// This function returns the number of entries that fit in a leaf page
+unsigned int DB::Index::get_leaf_capacity()
+{
+	return (PAGE_SIZE - NODE_HEADER_SIZE) / (key_size + sizeof(unsigned int));
+}
+
+/* This function returns the number of separator entries that fit in an internal page
+* Each internal node stores one more child page number than separators
+*/
+unsigned int DB::Index::get_internal_capacity()
+{
+	return (PAGE_SIZE - NODE_HEADER_SIZE - sizeof(unsigned int)) / (key_size + 2 * sizeof(unsigned int));
+}
+
+// This function reads a node from its page in the index file
+void DB::Index::read_node(unsigned int page, Node& node)
+{
+	std::string buffer(PAGE_SIZE, '\0');
+	index_file.seekg((std::streamoff) page * PAGE_SIZE);
+	index_file.read(&buffer[0], PAGE_SIZE);
+
+	unsigned int leaf;
+	unsigned int count;
+	memcpy(&leaf, &buffer[0], sizeof(unsigned int));
+	memcpy(&count, &buffer[sizeof(unsigned int)], sizeof(unsigned int));
+	memcpy(&node.next, &buffer[2 * sizeof(unsigned int)], sizeof(unsigned int));
+	node.leaf = leaf != 0;
+
+	size_t entry_size = key_size + sizeof(unsigned int);
+	size_t offset = NODE_HEADER_SIZE;
+
+	node.children.clear();
+	if (! node.leaf)
+	{
+		node.children.resize(count + 1);
+		memcpy(&node.children[0], &buffer[offset], (count + 1) * sizeof(unsigned int));
+		offset += (count + 1) * sizeof(unsigned int);
+	}
+
+	node.entries.resize(count);
+	for (unsigned int i = 0; i < count; i++, offset += entry_size)
+		node.entries[i].assign(&buffer[offset], entry_size);
+}
+
+// This function writes a node to its page in the index file
+void DB::Index::write_node(unsigned int page, Node& node)
+{
+	std::string buffer(PAGE_SIZE, '\0');
+
+	unsigned int leaf = node.leaf ? 1 : 0;
+	unsigned int count = node.entries.size();
+	memcpy(&buffer[0], &leaf, sizeof(unsigned int));
+	memcpy(&buffer[sizeof(unsigned int)], &count, sizeof(unsigned int));
+	memcpy(&buffer[2 * sizeof(unsigned int)], &node.next, sizeof(unsigned int));
+
+	size_t entry_size = key_size + sizeof(unsigned int);
+	size_t offset = NODE_HEADER_SIZE;
+
+	if (! node.leaf)
+	{
+		memcpy(&buffer[offset], &node.children[0], node.children.size() * sizeof(unsigned int));
+		offset += node.children.size() * sizeof(unsigned int);
+	}
+
+	for (unsigned int i = 0; i < count; i++, offset += entry_size)
+		memcpy(&buffer[offset], node.entries[i].data(), entry_size);
+
+	index_file.seekp((std::streamoff) page * PAGE_SIZE);
+	index_file.write(buffer.data(), PAGE_SIZE);
+}
+
+// This function writes the index metadata to page 0 of the index file
+void DB::Index::write_meta()
+{
+	std::string buffer(PAGE_SIZE, '\0');
+	memcpy(&buffer[0], INDEX_MAGIC.data(), INDEX_MAGIC.size());
+	size_t offset = INDEX_MAGIC.size();
+
+	memcpy(&buffer[offset], &type, sizeof(int));
+	offset += sizeof(int);
+	memcpy(&buffer[offset], &key_size, sizeof(unsigned int));
+	offset += sizeof(unsigned int);
+	memcpy(&buffer[offset], &root, sizeof(unsigned int));
+	offset += sizeof(unsigned int);
+	memcpy(&buffer[offset], &page_count, sizeof(unsigned int));
+
+	index_file.seekp(0);
+	index_file.write(buffer.data(), PAGE_SIZE);
+}
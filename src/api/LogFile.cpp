@@ -0,0 +1,225 @@
+/* This file contains function definitions for the LogFile class
+* On POSIX systems the file is written with write and synced with fsync, on Windows WriteFile and FlushFileBuffers are used
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#else
+#include <windows.h>
+#endif
+
+// This constructor initializes a closed file
+DB::LogFile::LogFile()
+{
+	handle = -1;
+}
+
+// This destructor closes the file
+DB::LogFile::~LogFile()
+{
+	close();
+}
+
+/* This function opens a file for appending, creating it if it doesn't exist
+* Returns false if the file can't be opened
+*/
+bool DB::LogFile::open(std::string filename)
+{
+	close();
+
+#ifndef _WIN32
+	int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (fd < 0)
+		return false;
+
+	handle = fd;
+#else
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	handle = (intptr_t) file;
+#endif
+
+	return true;
+}
+
+/* This function appends bytes to the end of the file with a single write where the platform allows it
+* Returns false if the bytes can't all be written
+*/
+bool DB::LogFile::append(const std::string& data)
+{
+	if (handle == -1)
+		return false;
+
+#ifndef _WIN32
+	size_t written = 0;
+	while (written < data.size())
+	{
+		ssize_t result = write((int) handle, data.data() + written, data.size() - written);
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			return false;
+
+		written += result;
+	}
+
+	return true;
+#else
+	LARGE_INTEGER zero;
+	zero.QuadPart = 0;
+	DWORD written = 0;
+	return SetFilePointerEx((HANDLE) handle, zero, NULL, FILE_END)
+		&& WriteFile((HANDLE) handle, data.data(), (DWORD) data.size(), &written, NULL) && written == data.size();
+#endif
+}
+
+/* This function reads bytes from a position in the file without moving the end the file is appended at
+* Returns false if the bytes can't all be read
+*/
+bool DB::LogFile::read(size_t offset, char* data, size_t size)
+{
+	if (handle == -1)
+		return false;
+
+#ifndef _WIN32
+	return pread((int) handle, data, size, offset) == (ssize_t) size;
+#else
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.Offset = (DWORD) offset;
+	overlapped.OffsetHigh = (DWORD) ((uint64_t) offset >> 32);
+
+	DWORD read_size = 0;
+	return ReadFile((HANDLE) handle, data, (DWORD) size, &read_size, &overlapped) && read_size == size;
+#endif
+}
+
+// This function blocks until everything written to the file is stored on the disk
+bool DB::LogFile::sync()
+{
+	if (handle == -1)
+		return false;
+
+#ifndef _WIN32
+	return fsync((int) handle) == 0;
+#else
+	return FlushFileBuffers((HANDLE) handle) != 0;
+#endif
+}
+
+// This function cuts the file down to a size
+bool DB::LogFile::truncate(size_t size)
+{
+	if (handle == -1)
+		return false;
+
+#ifndef _WIN32
+	return ftruncate((int) handle, size) == 0;
+#else
+	LARGE_INTEGER position;
+	position.QuadPart = size;
+	return SetFilePointerEx((HANDLE) handle, position, NULL, FILE_BEGIN) && SetEndOfFile((HANDLE) handle);
+#endif
+}
+
+// This function returns the size of the file in bytes
+size_t DB::LogFile::get_size()
+{
+	if (handle == -1)
+		return 0;
+
+#ifndef _WIN32
+	struct stat file_stat;
+	if (fstat((int) handle, &file_stat) != 0)
+		return 0;
+
+	return file_stat.st_size;
+#else
+	LARGE_INTEGER size;
+	if (! GetFileSizeEx((HANDLE) handle, &size))
+		return 0;
+
+	return size.QuadPart;
+#endif
+}
+
+// This function closes the file
+void DB::LogFile::close()
+{
+	if (handle == -1)
+		return;
+
+#ifndef _WIN32
+	::close((int) handle);
+#else
+	CloseHandle((HANDLE) handle);
+#endif
+
+	handle = -1;
+}
+
+// This function returns whether a file is open
+bool DB::LogFile::is_open()
+{
+	return handle != -1;
+}
+
+/* This function renames a file over another file in one step, so the target always holds one of the two files
+* The rename is written through to the disk, on POSIX systems by syncing the directory that holds the target
+* Returns false if the file can't be renamed, which leaves the target as it was
+*/
+bool DB::LogFile::replace(std::string source, std::string target)
+{
+	if (! rename_file(source, target))
+		return false;
+
+	sync_directory(target);
+	return true;
+}
+
+/* This function renames a file over another file in one step without waiting for the rename to reach the disk
+* On Windows the rename is written through to the disk before it returns
+* Returns false if the file can't be renamed, which leaves the target as it was
+*/
+bool DB::LogFile::rename_file(std::string source, std::string target)
+{
+#ifndef _WIN32
+	return rename(source.c_str(), target.c_str()) == 0;
+#else
+	return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#endif
+}
+
+/* This function writes the directory entries of the directory that holds a file through to the disk
+* Renames on Windows are already written through, so nothing is done there
+*/
+void DB::LogFile::sync_directory(std::string filename)
+{
+#ifndef _WIN32
+	std::string directory = ".";
+	size_t separator = filename.find_last_of('/');
+	if (separator == 0)
+		directory = "/";
+	else if (separator != std::string::npos)
+		directory = filename.substr(0, separator);
+
+	int fd = ::open(directory.c_str(), O_RDONLY);
+	if (fd >= 0)
+	{
+		fsync(fd);
+		::close(fd);
+	}
+#endif
+}
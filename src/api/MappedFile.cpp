@@ -0,0 +1,103 @@
+/* This file contains function definitions for the MappedFile class
+* On POSIX systems the file is mapped with mmap, elsewhere it is read in to a buffer
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// This constructor initializes an empty mapping
+DB::MappedFile::MappedFile()
+{
+	data = NULL;
+	length = 0;
+}
+
+// This destructor releases the mapping
+DB::MappedFile::~MappedFile()
+{
+	unmap();
+}
+
+/* This function maps the first length bytes of a file in to memory
+* It returns false if the file can't be opened or is shorter than the requested length
+*/
+bool DB::MappedFile::map(std::string filename, size_t length)
+{
+	unmap();
+
+	if (length == 0)
+		return false;
+
+#ifndef _WIN32
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < length)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* address = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (address == MAP_FAILED)
+		return false;
+
+	madvise(address, length, MADV_SEQUENTIAL);
+	data = static_cast<const char*>(address);
+#else
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	buffer.resize(length);
+	file.read(&buffer[0], length);
+
+	if ((size_t) file.gcount() != length)
+	{
+		buffer.clear();
+		return false;
+	}
+
+	data = &buffer[0];
+#endif
+
+	this -> length = length;
+	return true;
+}
+
+// This function releases the mapping
+void DB::MappedFile::unmap()
+{
+	if (data == NULL)
+		return;
+
+#ifndef _WIN32
+	munmap(const_cast<char*>(data), length);
+#else
+	buffer.clear();
+#endif
+
+	data = NULL;
+	length = 0;
+}
+
+// This getter returns a pointer to the start of the mapped file
+const char* DB::MappedFile::get_data()
+{
+	return data;
+}
+
+// This getter returns the number of mapped bytes
+size_t DB::MappedFile::get_length()
+{
+	return length;
+}
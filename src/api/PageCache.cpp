@@ -0,0 +1,290 @@
+/* This file contains function definitions for the PageCache class
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+// This constructor initializes an empty cache that passes every read and write through to the file
+DB::PageCache::PageCache()
+{
+	capacity = 0;
+	hand = 0;
+	hits = 0;
+	misses = 0;
+	released = 0;
+	held = 0;
+}
+
+/* This function sets the number of pages the cache holds
+* Dirty pages are written back and every page is dropped, and a capacity of 0 turns the cache off
+* Held pages have to be released first, since they would be dropped without being written back
+*/
+void DB::PageCache::set_capacity(std::fstream& file, size_t capacity)
+{
+	flush(file);
+	clear();
+	this -> capacity = capacity;
+}
+
+/* This function reads bytes at a position in the file through the cache
+* Reads too large to cache go straight to the file, and the changed bytes of any cached pages they cover are copied
+* over what was read, so dirty pages don't have to be written back first
+*/
+void DB::PageCache::read(std::fstream& file, std::streamoff position, char* data, size_t size)
+{
+	if (size > get_bypass_size())
+	{
+		file.seekg(position);
+		file.read(data, size);
+		size_t length = file.gcount();
+		file.clear();
+		std::fill(data + length, data + size, 0);
+
+		std::map<size_t, size_t>::iterator it = page_frames.lower_bound(position / PAGE_SIZE);
+		for (; it != page_frames.end() && (std::streamoff) it -> first * PAGE_SIZE < position + (std::streamoff) size; it++)
+		{
+			Page& page = pages[it -> second];
+			if (! page.dirty)
+				continue;
+
+			std::streamoff begin = std::max((std::streamoff) (page.number * PAGE_SIZE + page.dirty_begin), position);
+			std::streamoff end = std::min((std::streamoff) (page.number * PAGE_SIZE + page.dirty_end), position + (std::streamoff) size);
+			if (begin < end)
+				memcpy(data + (begin - position), &page.data[begin - page.number * PAGE_SIZE], end - begin);
+		}
+
+		return;
+	}
+
+	while (size > 0)
+	{
+		size_t number = position / PAGE_SIZE;
+		size_t offset = position % PAGE_SIZE;
+		size_t run = std::min(size, (size_t) PAGE_SIZE - offset);
+
+		Page& page = pages[find_page(file, number)];
+		memcpy(data, &page.data[offset], run);
+
+		position += run;
+		data += run;
+		size -= run;
+	}
+}
+
+/* This function writes bytes at a position in the file through the cache
+* Changed pages are only written back when they are evicted or the cache is flushed
+* Writes too large to cache go straight to the file, and the cached pages they cover are dropped
+* A hold sequence number other than 0 holds the changed pages until it is released, which can_hold checks is possible
+*/
+void DB::PageCache::write(std::fstream& file, std::streamoff position, const char* data, size_t size, uint64_t hold)
+{
+	if (size > get_bypass_size())
+	{
+		write_back_range(file, position, size);
+		file.seekp(position);
+		file.write(data, size);
+		return;
+	}
+
+	while (size > 0)
+	{
+		size_t number = position / PAGE_SIZE;
+		size_t offset = position % PAGE_SIZE;
+		size_t run = std::min(size, (size_t) PAGE_SIZE - offset);
+
+		Page& page = pages[find_page(file, number)];
+		memcpy(&page.data[offset], data, run);
+		if (! page.dirty)
+		{
+			page.dirty_begin = offset;
+			page.dirty_end = offset + run;
+		}
+
+		page.dirty_begin = std::min(page.dirty_begin, offset);
+		page.dirty_end = std::max(page.dirty_end, offset + run);
+		page.dirty = true;
+
+		if (hold > released)
+		{
+			if (! is_held(page))
+				held++;
+			page.hold = std::max(page.hold, hold);
+		}
+
+		position += run;
+		data += run;
+		size -= run;
+	}
+}
+
+/* This function checks whether a write can go through the cache with its pages held
+* Held pages can't be evicted, so they may only fill half of the cache, and writes too large to cache can't be held
+*/
+bool DB::PageCache::can_hold(std::streamoff position, size_t size)
+{
+	if (size > get_bypass_size())
+		return false;
+
+	size_t first = position / PAGE_SIZE;
+	size_t last = (position + size - 1) / PAGE_SIZE;
+	return held + (last - first + 1) <= capacity / 2;
+}
+
+/* This function releases the pages held with sequence numbers up to the given one, so they can be written back
+* Sequence numbers are released in order, so an older sequence number changes nothing
+*/
+void DB::PageCache::release(uint64_t sequence)
+{
+	if (sequence <= released)
+		return;
+
+	released = sequence;
+	held = 0;
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		if (is_held(pages[i]))
+			held++;
+	}
+}
+
+// This function writes every dirty page back to the file, except held pages which stay dirty until they are released
+void DB::PageCache::flush(std::fstream& file)
+{
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		if (pages[i].dirty && ! is_held(pages[i]))
+			write_back(file, pages[i]);
+	}
+}
+
+// This function drops every page without writing dirty pages back, for when the file was replaced or changed elsewhere
+void DB::PageCache::clear()
+{
+	pages.clear();
+	page_frames.clear();
+	hand = 0;
+	held = 0;
+}
+
+// This getter returns the number of pages held until their write-ahead log entries are synced
+size_t DB::PageCache::get_held()
+{
+	return held;
+}
+
+// This getter returns the number of page accesses that found the page in the cache
+size_t DB::PageCache::get_hits()
+{
+	return hits;
+}
+
+// This getter returns the number of page accesses that had to read the page from the file
+size_t DB::PageCache::get_misses()
+{
+	return misses;
+}
+
+/* This function returns the frame holding a page, reading the page in to the cache if it isn't there
+* Once the cache is full a frame is reused with the CLOCK algorithm, which passes over and clears
+* recently used frames until it finds one that wasn't used since the hand last passed it
+* Held frames are passed over as well, and at most half of the frames are ever held
+*/
+size_t DB::PageCache::find_page(std::fstream& file, size_t number)
+{
+	std::map<size_t, size_t>::iterator it = page_frames.find(number);
+	if (it != page_frames.end())
+	{
+		hits++;
+		pages[it -> second].referenced = true;
+		return it -> second;
+	}
+
+	misses++;
+
+	size_t frame = pages.size();
+	if (pages.size() < capacity)
+	{
+		pages.push_back(Page());
+		pages[frame].data.resize(PAGE_SIZE);
+	}
+	else
+	{
+		while (pages[hand].referenced || is_held(pages[hand]))
+		{
+			pages[hand].referenced = false;
+			hand = (hand + 1) % pages.size();
+		}
+
+		frame = hand;
+		hand = (hand + 1) % pages.size();
+
+		if (pages[frame].dirty)
+			write_back(file, pages[frame]);
+
+		page_frames.erase(pages[frame].number);
+	}
+
+	// Bytes past the end of the file read as zeros
+	Page& page = pages[frame];
+	page.number = number;
+	page.dirty = false;
+	page.referenced = true;
+	page.hold = 0;
+
+	file.seekg((std::streamoff) number * PAGE_SIZE);
+	file.read(&page.data[0], PAGE_SIZE);
+	size_t length = file.gcount();
+	file.clear();
+	std::fill(page.data.begin() + length, page.data.end(), 0);
+
+	page_frames[number] = frame;
+	return frame;
+}
+
+// This function returns whether a page is held by a sequence number that hasn't been released
+bool DB::PageCache::is_held(const Page& page)
+{
+	return page.hold > released;
+}
+
+// This function writes the changed part of a page back to the file, from the first changed byte to the last
+void DB::PageCache::write_back(std::fstream& file, Page& page)
+{
+	file.seekp((std::streamoff) page.number * PAGE_SIZE + page.dirty_begin);
+	file.write(&page.data[page.dirty_begin], page.dirty_end - page.dirty_begin);
+	page.dirty = false;
+}
+
+/* This function writes back and drops the cached pages in a range of the file before it is written directly
+* Writes too large to cache are never held, and the caller releases held pages before making one
+*/
+void DB::PageCache::write_back_range(std::fstream& file, std::streamoff position, size_t size)
+{
+	size_t first = position / PAGE_SIZE;
+	size_t last = (position + size - 1) / PAGE_SIZE;
+
+	std::map<size_t, size_t>::iterator it = page_frames.lower_bound(first);
+	while (it != page_frames.end() && it -> first <= last)
+	{
+		Page& page = pages[it -> second];
+		if (page.dirty)
+			write_back(file, page);
+
+		// Dropped frames are left unreferenced so the CLOCK hand reuses them next time it passes
+		page.referenced = false;
+		page.number = (size_t) -1 - it -> second;
+		page_frames.erase(it++);
+	}
+}
+
+/* This function returns the largest read or write that goes through the cache
+* Larger transfers, like batch inserts, would push every other page out of the cache
+*/
+size_t DB::PageCache::get_bypass_size()
+{
+	if (capacity == 0)
+		return 0;
+
+	return std::max(capacity / 4, (size_t) 1) * PAGE_SIZE;
+}
@@ -0,0 +1,344 @@
+/* This file contains function definitions for the Predicate class
+* Comparisons are converted to inclusive ranges of stored values
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+#include <climits>
+#include <cmath>
+#include <limits>
+
+/* This function returns the next 16 character string value up or down in byte order
+* Fixed width strings compare like big-endian numbers, so this adds or subtracts one with a carry
+* The return value is false if there is no such value
+*/
+static bool step_char16(std::string& value, int direction)
+{
+	const unsigned char limit = direction > 0 ? 0xFF : 0x00;
+
+	for (int i = value.size() - 1; i >= 0; i--)
+	{
+		unsigned char byte = value[i];
+		if (byte != limit)
+		{
+			value[i] = (char) (byte + direction);
+			return true;
+		}
+
+		value[i] = (char) (direction > 0 ? 0x00 : 0xFF);
+	}
+
+	return false;
+}
+
+// This constructor initializes a predicate that matches nothing until a comparison is set
+DB::Predicate::Predicate()
+{
+	set_float_range("", 1.0, 0.0);
+	set_char16_range("", "", "");
+	set_int_range("", 1, 0);
+}
+
+// This function sets the bounds of an integer comparison
+void DB::Predicate::set_int_bounds(int op, int value)
+{
+	int low = INT_MIN;
+	int high = INT_MAX;
+
+	if (op == OP_EQ)
+	{
+		low = value;
+		high = value;
+	}
+	else if (op == OP_LT)
+	{
+		high = value - 1;
+		if (value == INT_MIN)
+		{
+			low = 1;
+			high = 0;
+		}
+	}
+	else if (op == OP_LE)
+	{
+		high = value;
+	}
+	else if (op == OP_GT)
+	{
+		low = value + 1;
+		if (value == INT_MAX)
+		{
+			low = 1;
+			high = 0;
+		}
+	}
+	else if (op == OP_GE)
+	{
+		low = value;
+	}
+
+	type = ATTR_INT;
+	int_low = low;
+	int_high = high;
+}
+
+/* This function sets the bounds of a floating point comparison
+* Strict comparisons use the next representable value, and NaN values never match
+*/
+void DB::Predicate::set_float_bounds(int op, float value)
+{
+	const float infinity = std::numeric_limits<float>::infinity();
+	float low = -infinity;
+	float high = infinity;
+
+	if (op == OP_EQ)
+	{
+		low = value;
+		high = value;
+	}
+	else if (op == OP_LT)
+	{
+		high = nextafterf(value, -infinity);
+	}
+	else if (op == OP_LE)
+	{
+		high = value;
+	}
+	else if (op == OP_GT)
+	{
+		low = nextafterf(value, infinity);
+	}
+	else if (op == OP_GE)
+	{
+		low = value;
+	}
+
+	/* Nothing is below negative infinity or above positive infinity,
+	* and the next representable value past an infinity is the infinity itself
+	*/
+	if (value != value || (op == OP_LT && value == -infinity) || (op == OP_GT && value == infinity))
+	{
+		low = infinity;
+		high = -infinity;
+	}
+
+	type = ATTR_FLOAT;
+	float_low = low;
+	float_high = high;
+}
+
+/* This function sets the bounds of a 16 character string comparison
+* The value is padded the same way it is stored on disk before comparing
+*/
+void DB::Predicate::set_char16_bounds(int op, std::string value)
+{
+	FixedString16 fixed_value(value);
+	std::string low(fixed_value.get_size(), (char) 0x00);
+	std::string high(fixed_value.get_size(), (char) 0xFF);
+	std::string empty_low = high;
+	std::string empty_high = low;
+
+	if (op == OP_EQ)
+	{
+		low = fixed_value.get();
+		high = fixed_value.get();
+	}
+	else if (op == OP_LT)
+	{
+		high = fixed_value.get();
+		if (! step_char16(high, -1))
+		{
+			low = empty_low;
+			high = empty_high;
+		}
+	}
+	else if (op == OP_LE)
+	{
+		high = fixed_value.get();
+	}
+	else if (op == OP_GT)
+	{
+		low = fixed_value.get();
+		if (! step_char16(low, 1))
+		{
+			low = empty_low;
+			high = empty_high;
+		}
+	}
+	else if (op == OP_GE)
+	{
+		low = fixed_value.get();
+	}
+
+	type = ATTR_CHAR16;
+	char16_low = low;
+	char16_high = high;
+}
+
+// These functions set a comparison on a field given by name
+void DB::Predicate::set_int(std::string name, int op, int value)
+{
+	set_name(name);
+	set_int_bounds(op, value);
+}
+
+void DB::Predicate::set_float(std::string name, int op, float value)
+{
+	set_name(name);
+	set_float_bounds(op, value);
+}
+
+void DB::Predicate::set_char16(std::string name, int op, std::string value)
+{
+	set_name(name);
+	set_char16_bounds(op, value);
+}
+
+// This function sets an inclusive range of integer values
+void DB::Predicate::set_int_range(std::string name, int low, int high)
+{
+	set_name(name);
+	this -> type = ATTR_INT;
+	int_low = low;
+	int_high = high;
+}
+
+/* This function sets a predicate that matches every record
+* The range covers every id, and removed records are skipped by scans as they are for any predicate
+*/
+void DB::Predicate::set_all()
+{
+	set_name("id");
+	this -> type = ATTR_ID;
+	int_low = INT_MIN;
+	int_high = INT_MAX;
+}
+
+// This function sets an inclusive range of floating point values
+void DB::Predicate::set_float_range(std::string name, float low, float high)
+{
+	set_name(name);
+	this -> type = ATTR_FLOAT;
+	float_low = low;
+	float_high = high;
+}
+
+// This function sets an inclusive range of 16 character string values
+void DB::Predicate::set_char16_range(std::string name, std::string low, std::string high)
+{
+	set_name(name);
+	this -> type = ATTR_CHAR16;
+	char16_low = FixedString16(low).get();
+	char16_high = FixedString16(high).get();
+}
+
+/* These functions set a comparison or range on a field given by a handle from the database schema
+* The handle is kept instead of the name, so searches on the database the schema came from
+* compare the field at the handle offset without looking the name up
+*/
+void DB::Predicate::set_int(const DB::FieldHandle& field, int op, int value)
+{
+	this -> field = field;
+	set_int_bounds(op, value);
+}
+
+void DB::Predicate::set_float(const DB::FieldHandle& field, int op, float value)
+{
+	this -> field = field;
+	set_float_bounds(op, value);
+}
+
+void DB::Predicate::set_char16(const DB::FieldHandle& field, int op, std::string value)
+{
+	this -> field = field;
+	set_char16_bounds(op, value);
+}
+
+void DB::Predicate::set_int_range(const DB::FieldHandle& field, int low, int high)
+{
+	this -> field = field;
+	type = ATTR_INT;
+	int_low = low;
+	int_high = high;
+}
+
+void DB::Predicate::set_float_range(const DB::FieldHandle& field, float low, float high)
+{
+	this -> field = field;
+	type = ATTR_FLOAT;
+	float_low = low;
+	float_high = high;
+}
+
+void DB::Predicate::set_char16_range(const DB::FieldHandle& field, std::string low, std::string high)
+{
+	this -> field = field;
+	type = ATTR_CHAR16;
+	char16_low = FixedString16(low).get();
+	char16_high = FixedString16(high).get();
+}
+
+// This function sets the name of the compared field and forgets any handle
+void DB::Predicate::set_name(std::string name)
+{
+	this -> name = FixedString8(name);
+	field = FieldHandle();
+}
+
+// This getter returns the field name, which is the handle name if the field was given by a handle
+DB::FixedString8 DB::Predicate::get_name()
+{
+	if (field.is_valid())
+		return FixedString8(field.get_name());
+
+	return name;
+}
+
+// This getter returns the handle of the compared field, which isn't valid if the field was given by name
+const DB::FieldHandle& DB::Predicate::get_field()
+{
+	return field;
+}
+
+// This getter returns the field type
+int DB::Predicate::get_type()
+{
+	return type;
+}
+
+// This getter returns the lowest matching integer value
+int DB::Predicate::get_int_low()
+{
+	return int_low;
+}
+
+// This getter returns the highest matching integer value
+int DB::Predicate::get_int_high()
+{
+	return int_high;
+}
+
+// This getter returns the lowest matching floating point value
+float DB::Predicate::get_float_low()
+{
+	return float_low;
+}
+
+// This getter returns the highest matching floating point value
+float DB::Predicate::get_float_high()
+{
+	return float_high;
+}
+
+// This getter returns the lowest matching 16 character string value
+std::string DB::Predicate::get_char16_low()
+{
+	return char16_low;
+}
+
+// This getter returns the highest matching 16 character string value
+std::string DB::Predicate::get_char16_high()
+{
+	return char16_high;
+}
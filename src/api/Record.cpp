@@ -5,38 +5,76 @@
 
 #include <DB.h>
 
-// This function writes record information to disk using a stream object
-void DB::Record::write(std::fstream& stream)
+/* This function writes record information to disk using a stream object
+* Version 1 records are written as named Attrs grouped by type
+* Version 2 records are written as packed values with the id first, followed by the table fields in table order
+*/
+void DB::Record::write(std::ostream& stream, unsigned int format)
 {	
-	attr_id.write(stream);
+	attr_id.write(stream, format);
+
+	if (format != FORMAT_V1)
+	{
+		const std::map<std::string, Field>& fields = table.get_fields();
+
+		std::map<std::string, Field>::const_iterator it;
+		for (it = fields.begin(); it != fields.end(); it++)
+		{
+			const std::string& name = it -> first;
+			int type = it -> second.get_type();
+
+			if (type == ATTR_INT)
+				attr_ints[name].write(stream, format);
+			else if (type == ATTR_FLOAT)
+				attr_floats[name].write(stream, format);
+			else if (type == ATTR_CHAR16)
+				attr_char16s[name].write(stream, format);
+		}
+
+		return;
+	}
 
 	std::map<std::string, AttrInt>::const_iterator iti;
 	for (iti = attr_ints.begin(); iti != attr_ints.end(); iti++)
 	{
 		AttrInt attr_int = iti -> second;
-		attr_int.write(stream);
+		attr_int.write(stream, format);
 	}
 
 	std::map<std::string, AttrFloat>::const_iterator itf;
 	for (itf = attr_floats.begin(); itf != attr_floats.end(); itf++)
 	{
 		AttrFloat attr_float = itf -> second;
-		attr_float.write(stream);
+		attr_float.write(stream, format);
 	}
 
 	std::map<std::string, AttrChar16>::const_iterator itc;
 	for (itc = attr_char16s.begin(); itc != attr_char16s.end(); itc++)
 	{
 		AttrChar16 attr_char16 = itc -> second;
-		attr_char16.write(stream);
+		attr_char16.write(stream, format);
 	}
 }
 
 // This function reads in record information from disk using a stream object
-void DB::Record::read(std::fstream& stream)
+void DB::Record::read(std::istream& stream, unsigned int format)
 {
-	std::map<std::string, Field> fields = table.get_fields();
-	const int CHAR_16_SIZE = 16;
+	const std::map<std::string, Field>& fields = table.get_fields();
+
+	// Version 2 records have no Attr names on disk, so take them from the table in order
+	if (format != FORMAT_V1)
+	{
+		attr_id.read(stream);
+
+		std::map<std::string, Field>::const_iterator it;
+		for (it = fields.begin(); it != fields.end(); it++)
+		{
+			if (it -> second.get_type() != ATTR_ID)
+				read_attr(stream, it -> second.get_name(), it -> second.get_type());
+		}
+
+		return;
+	}
 
 	std::map<std::string, Field>::const_iterator it;
 	for (it = fields.begin(); it != fields.end(); it++)
@@ -47,35 +85,41 @@ void DB::Record::read(std::fstream& stream)
 		/* Determine how much to read based on the field type in the table,
 		* read the data, and add the attributes to the record
 		*/
-		int type = fields[name.get()].get_type();
+		std::map<std::string, Field>::const_iterator field = fields.find(name.get());
+		if (field != fields.end())
+			read_attr(stream, name, field -> second.get_type());
+	}
+}
 
-		if (type == -1)
-		{
-			AttrID attr_id;
-			attr_id.read(stream);
-			this -> attr_id = attr_id;
-		}
-		else if (type == 0) //AttrInt
-		{
-			AttrInt attr;
-			attr.read(stream);
-			attr.set_name(name);
-			attr_ints[attr.get_name().get()] = attr;
-		}
-		else if (type == 1) //AttrFloat
-		{
-			AttrFloat attr;
-			attr.read(stream);
-			attr.set_name(name);
-			attr_floats[attr.get_name().get()] = attr;
-		}
-		else if (type == 2) //AttrChar16
-		{
-			AttrChar16 attr;
-			attr.read(stream);
-			attr.set_name(name);
-			attr_char16s[attr.get_name().get()] = attr;
-		}
+// This function reads a single Attr of the given type and adds it to the record
+void DB::Record::read_attr(std::istream& stream, FixedString8 name, int type)
+{
+	if (type == -1)
+	{
+		AttrID attr_id;
+		attr_id.read(stream);
+		this -> attr_id = attr_id;
+	}
+	else if (type == 0) //AttrInt
+	{
+		AttrInt attr;
+		attr.read(stream);
+		attr.set_name(name);
+		attr_ints[attr.get_name().get()] = attr;
+	}
+	else if (type == 1) //AttrFloat
+	{
+		AttrFloat attr;
+		attr.read(stream);
+		attr.set_name(name);
+		attr_floats[attr.get_name().get()] = attr;
+	}
+	else if (type == 2) //AttrChar16
+	{
+		AttrChar16 attr;
+		attr.read(stream);
+		attr.set_name(name);
+		attr_char16s[attr.get_name().get()] = attr;
 	}
 }
 
@@ -180,11 +224,33 @@ std::string DB::Record::get_char16(std::string name)
 }
 
 // This function calculates the size of a whole record
-int DB::Record::get_size()
+int DB::Record::get_size(unsigned int format)
 {	
 	int size = 0;
 
 	size += attr_id.get_size();
+	
+	// Version 2 records are sized by the table fields since no Attr names are stored
+	if (format != FORMAT_V1)
+	{
+		const std::map<std::string, Field>& fields = table.get_fields();
+
+		std::map<std::string, Field>::const_iterator it;
+		for (it = fields.begin(); it != fields.end(); it++)
+		{
+			int type = it -> second.get_type();
+
+			if (type == ATTR_INT)
+				size += AttrInt().get_size();
+			else if (type == ATTR_FLOAT)
+				size += AttrFloat().get_size();
+			else if (type == ATTR_CHAR16)
+				size += AttrChar16().get_size();
+		}
+
+		return size;
+	}
+
 	size += attr_id.get_name().get_size();
 
 	std::map<std::string, AttrInt>::const_iterator iti;
@@ -220,41 +286,42 @@ int DB::Record::get_size()
 */
 void DB::Record::sanitize()
 {
-	std::map<std::string, Field> fields = table.get_fields();
+	const std::map<std::string, Field>& fields = table.get_fields();
 
 	std::map<std::string, Field>::const_iterator it;
 	for (it = fields.begin(); it != fields.end(); it++)
 	{
-		Field field = it -> second;
+		const std::string& name = it -> first;
+		int type = it -> second.get_type();
 
-		if (field.get_type() == ATTR_INT)
+		if (type == ATTR_INT)
 		{
-			if (attr_ints.count(field.get_name().get()) == 0)
+			if (attr_ints.count(name) == 0)
 			{
 				AttrInt attr_int;
-				attr_int.set_name(FixedString8(field.get_name().get()));
+				attr_int.set_name(FixedString8(name));
 				attr_int.set_data(0);
-				attr_ints[field.get_name().get()] = attr_int;
+				attr_ints[name] = attr_int;
 			}
 		}
-		else if (field.get_type() == ATTR_FLOAT)
+		else if (type == ATTR_FLOAT)
 		{
-			if (attr_floats.count(field.get_name().get()) == 0)
+			if (attr_floats.count(name) == 0)
 			{
 				AttrFloat attr_float;
-				attr_float.set_name(FixedString8(field.get_name().get()));
+				attr_float.set_name(FixedString8(name));
 				attr_float.set_data(0.0);
-				attr_floats[field.get_name().get()] = attr_float;
+				attr_floats[name] = attr_float;
 			}
 		}
-		else if (field.get_type() == ATTR_CHAR16)
+		else if (type == ATTR_CHAR16)
 		{
-			if (attr_char16s.count(field.get_name().get()) == 0)
+			if (attr_char16s.count(name) == 0)
 			{
 				AttrChar16 attr_char16;
-				attr_char16.set_name(FixedString8(field.get_name().get()));
+				attr_char16.set_name(FixedString8(name));
 				attr_char16.set_data("");
-				attr_char16s[field.get_name().get()] = attr_char16;
+				attr_char16s[name] = attr_char16;
 			}
 		}
 	}
@@ -0,0 +1,149 @@
+/* This file contains function definitions for the RecordView class
+* Field values are read straight from the mapped record slot at their precomputed offsets
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+// This constructor points the view at a record slot in the mapped records of a database
+DB::RecordView::RecordView(DB& db, const char* records, unsigned int slot) : db(db), records(records), slot(slot)
+{
+}
+
+// This getter returns the record id
+unsigned int DB::RecordView::get_id()
+{
+	unsigned int id = 0;
+	const char* value = get_value("id", ATTR_ID);
+	if (value != NULL)
+		memcpy(&id, value, sizeof(unsigned int));
+
+	return id;
+}
+
+// This getter returns the value of an integer field, or 0 if the record has no such field
+int DB::RecordView::get_int(std::string name)
+{
+	int data = 0;
+	const char* value = get_value(name, ATTR_INT);
+	if (value != NULL)
+		memcpy(&data, value, sizeof(int));
+
+	return data;
+}
+
+// This getter returns the value of a floating point field, or 0 if the record has no such field
+float DB::RecordView::get_float(std::string name)
+{
+	float data = 0;
+	const char* value = get_value(name, ATTR_FLOAT);
+	if (value != NULL)
+		memcpy(&data, value, sizeof(float));
+
+	return data;
+}
+
+// This getter returns the value of a character field, or an empty string if the record has no such field
+std::string DB::RecordView::get_char16(std::string name)
+{
+	const char* value = get_value(name, ATTR_CHAR16);
+	if (value == NULL)
+		return "";
+
+	return std::string(value, FixedString16().get_size());
+}
+
+// These getters return the value of a field given by a handle from the database schema
+int DB::RecordView::get_int(const DB::FieldHandle& field)
+{
+	int data = 0;
+	const char* value = get_value(field, ATTR_INT);
+	if (value != NULL)
+		memcpy(&data, value, sizeof(int));
+
+	return data;
+}
+
+float DB::RecordView::get_float(const DB::FieldHandle& field)
+{
+	float data = 0;
+	const char* value = get_value(field, ATTR_FLOAT);
+	if (value != NULL)
+		memcpy(&data, value, sizeof(float));
+
+	return data;
+}
+
+std::string DB::RecordView::get_char16(const DB::FieldHandle& field)
+{
+	const char* value = get_value(field, ATTR_CHAR16);
+	if (value == NULL)
+		return "";
+
+	return std::string(value, field.get_size());
+}
+
+// This function reads the whole record in to a Record object that stays valid after the search
+DB::Record DB::RecordView::get_record()
+{
+	std::string record(db.record_size, '\0');
+	db.read_slot(records, slot, &record[0]);
+	std::istringstream record_stream(record);
+
+	Record temp_record;
+	temp_record.set_table(db.table);
+	temp_record.read(record_stream, db.format_version);
+	return temp_record;
+}
+
+/* This function copies the record in to a FlatRecord that stays valid after the search
+* Row records in the current format are copied straight from the mapped file
+*/
+DB::FlatRecord DB::RecordView::get_flat_record()
+{
+	if (db.format_version != FORMAT_V1 && db.layout == LAYOUT_ROWS)
+		return FlatRecord(db.schema, records + db.get_value_position(slot, 0, db.record_size));
+
+	std::string record;
+	if (db.format_version == FORMAT_V1)
+	{
+		std::ostringstream record_stream;
+		get_record().write(record_stream, FORMAT_CURRENT);
+		record = record_stream.str();
+	}
+	else
+	{
+		record.resize(db.record_size);
+		db.read_slot(records, slot, &record[0]);
+	}
+
+	return FlatRecord(db.schema, record.data());
+}
+
+// This function returns the address of a field value in the mapped record, or NULL if the record has no such field of the type
+const char* DB::RecordView::get_value(std::string name, int type)
+{
+	FixedString8 fixed_name(name);
+	std::map<std::string, int>::iterator it = db.field_types.find(fixed_name.get());
+	if (it == db.field_types.end() || it -> second != type)
+		return NULL;
+
+	unsigned int offset = db.field_offsets.find(it -> first) -> second;
+	unsigned int size = db.field_sizes.find(it -> first) -> second;
+	return records + db.get_value_position(slot, offset, size);
+}
+
+/* This function returns the address of a field value given by a handle, or NULL if the handle has another type
+* Handle offsets are offsets in current format records, so version 1 records look the field up by name instead
+*/
+const char* DB::RecordView::get_value(const DB::FieldHandle& field, int type)
+{
+	if (db.format_version == FORMAT_V1)
+		return get_value(field.get_name(), type);
+
+	if (field.get_type() != type || field.get_offset() + field.get_size() > db.record_size)
+		return NULL;
+
+	return records + db.get_value_position(slot, field.get_offset(), field.get_size());
+}
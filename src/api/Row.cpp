@@ -0,0 +1,77 @@
+/* This file contains function definitions for the Row class
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+/* This constructor copies the fields in the row layout out of a record matched by a search
+* The values are copied in to size bytes allocated from the arena
+*/
+DB::Row::Row(std::shared_ptr<const RowLayout> layout, std::shared_ptr<Arena> arena, unsigned int size, RecordView& record)
+	: layout(layout), arena(arena)
+{
+	char* row_values = arena -> allocate(size);
+	for (RowLayout::const_iterator it = layout -> begin(); it != layout -> end(); it++)
+	{
+		const RowField& field = it -> second;
+		const char* value = record.records + record.db.get_value_position(record.slot, field.record_offset, field.size);
+		memcpy(row_values + field.offset, value, field.size);
+	}
+
+	values = row_values;
+}
+
+// This getter returns the record id
+unsigned int DB::Row::get_id()
+{
+	unsigned int id = 0;
+	const char* value = get_value("id", ATTR_ID);
+	if (value != NULL)
+		memcpy(&id, value, sizeof(unsigned int));
+
+	return id;
+}
+
+// This getter returns the value of an integer field, or 0 if the field wasn't selected
+int DB::Row::get_int(std::string name)
+{
+	int data = 0;
+	const char* value = get_value(name, ATTR_INT);
+	if (value != NULL)
+		memcpy(&data, value, sizeof(int));
+
+	return data;
+}
+
+// This getter returns the value of a floating point field, or 0 if the field wasn't selected
+float DB::Row::get_float(std::string name)
+{
+	float data = 0;
+	const char* value = get_value(name, ATTR_FLOAT);
+	if (value != NULL)
+		memcpy(&data, value, sizeof(float));
+
+	return data;
+}
+
+// This getter returns the value of a character field, or an empty string if the field wasn't selected
+std::string DB::Row::get_char16(std::string name)
+{
+	const char* value = get_value(name, ATTR_CHAR16);
+	if (value == NULL)
+		return "";
+
+	return std::string(value, FixedString16().get_size());
+}
+
+// This function returns the address of a field value in the row, or NULL if the field of the type wasn't selected
+const char* DB::Row::get_value(std::string name, int type)
+{
+	FixedString8 fixed_name(name);
+	RowLayout::const_iterator it = layout -> find(fixed_name.get());
+	if (it == layout -> end() || it -> second.type != type)
+		return NULL;
+
+	return values + it -> second.offset;
+}
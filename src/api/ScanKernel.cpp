@@ -0,0 +1,202 @@
+/* This file contains function definitions for the ScanKernel class
+* The kernels compare one field across a block of fixed-size records in place, using the id and value strides
+* so the same kernels scan row records and the columns of a row group
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_KERNEL_AVX2
+#include <immintrin.h>
+#endif
+
+// Define the number of records checked by each kernel call
+const unsigned int DB::ScanKernel::BLOCK_SIZE;
+
+// This kernel checks integer values one record at a time
+static uint64_t match_int_scalar(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+	unsigned int value_stride, int low, int high)
+{
+	uint64_t bitmap = 0;
+	for (unsigned int i = 0; i < count; i++, ids += id_stride, values += value_stride)
+	{
+		unsigned int id;
+		int value;
+		memcpy(&id, ids, sizeof(unsigned int));
+		memcpy(&value, values, sizeof(int));
+
+		if (id != 0 && value >= low && value <= high)
+			bitmap |= (uint64_t) 1 << i;
+	}
+
+	return bitmap;
+}
+
+// This kernel checks floating point values one record at a time
+static uint64_t match_float_scalar(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+	unsigned int value_stride, float low, float high)
+{
+	uint64_t bitmap = 0;
+	for (unsigned int i = 0; i < count; i++, ids += id_stride, values += value_stride)
+	{
+		unsigned int id;
+		float value;
+		memcpy(&id, ids, sizeof(unsigned int));
+		memcpy(&value, values, sizeof(float));
+
+		if (id != 0 && value >= low && value <= high)
+			bitmap |= (uint64_t) 1 << i;
+	}
+
+	return bitmap;
+}
+
+#ifdef SCAN_KERNEL_AVX2
+
+/* This function loads eight 32 bit values spaced stride bytes apart
+* Contiguous values, such as the id and number columns of a row group, are loaded directly instead of gathered
+*/
+__attribute__((target("avx2")))
+static inline __m256i load_strided(const char* values, unsigned int stride)
+{
+	if (stride == sizeof(int))
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values));
+
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+	return _mm256_i32gather_epi32(reinterpret_cast<const int*>(values), index, 1);
+}
+
+/* This kernel checks integer values eight records at a time
+* The id and value of each record are loaded using their strides, compared against the bounds,
+* and the comparison mask is packed in to the bitmap
+*/
+__attribute__((target("avx2")))
+static uint64_t match_int_avx2(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+	unsigned int value_stride, int low, int high)
+{
+	const __m256i low_bound = _mm256_set1_epi32(low);
+	const __m256i high_bound = _mm256_set1_epi32(high);
+	const __m256i zero = _mm256_setzero_si256();
+
+	uint64_t bitmap = 0;
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i block_ids = load_strided(ids + (size_t) i * id_stride, id_stride);
+		__m256i block_values = load_strided(values + (size_t) i * value_stride, value_stride);
+
+		// A record misses if it is removed or its value is outside the bounds
+		__m256i miss = _mm256_or_si256(_mm256_cmpgt_epi32(low_bound, block_values), _mm256_cmpgt_epi32(block_values, high_bound));
+		miss = _mm256_or_si256(miss, _mm256_cmpeq_epi32(block_ids, zero));
+
+		uint64_t mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xff;
+		bitmap |= mask << i;
+	}
+
+	// Check any remaining records one at a time
+	if (i < count)
+	{
+		bitmap |= match_int_scalar(ids + (size_t) i * id_stride, values + (size_t) i * value_stride, count - i,
+			id_stride, value_stride, low, high) << i;
+	}
+
+	return bitmap;
+}
+
+/* This kernel checks floating point values eight records at a time
+* Ordered comparisons are used so NaN values never match
+*/
+__attribute__((target("avx2")))
+static uint64_t match_float_avx2(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+	unsigned int value_stride, float low, float high)
+{
+	const __m256 low_bound = _mm256_set1_ps(low);
+	const __m256 high_bound = _mm256_set1_ps(high);
+	const __m256i zero = _mm256_setzero_si256();
+
+	uint64_t bitmap = 0;
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i block_ids = load_strided(ids + (size_t) i * id_stride, id_stride);
+		__m256 block_values = _mm256_castsi256_ps(load_strided(values + (size_t) i * value_stride, value_stride));
+
+		// A record hits if it isn't removed and its value is inside the bounds
+		__m256 hit = _mm256_and_ps(_mm256_cmp_ps(block_values, low_bound, _CMP_GE_OQ), _mm256_cmp_ps(block_values, high_bound, _CMP_LE_OQ));
+		hit = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block_ids, zero)), hit);
+
+		uint64_t mask = _mm256_movemask_ps(hit);
+		bitmap |= mask << i;
+	}
+
+	// Check any remaining records one at a time
+	if (i < count)
+	{
+		bitmap |= match_float_scalar(ids + (size_t) i * id_stride, values + (size_t) i * value_stride, count - i,
+			id_stride, value_stride, low, high) << i;
+	}
+
+	return bitmap;
+}
+
+#endif
+
+/* This function returns whether the CPU supports the AVX2 kernels
+* The check is made once and remembered
+*/
+bool DB::ScanKernel::has_avx2()
+{
+#ifdef SCAN_KERNEL_AVX2
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported;
+#else
+	return false;
+#endif
+}
+
+// This kernel checks integer values within a block of records
+uint64_t DB::ScanKernel::match_int(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+	unsigned int value_stride, int low, int high, bool vectorized)
+{
+#ifdef SCAN_KERNEL_AVX2
+	if (vectorized && has_avx2())
+		return match_int_avx2(ids, values, count, id_stride, value_stride, low, high);
+#endif
+
+	return match_int_scalar(ids, values, count, id_stride, value_stride, low, high);
+}
+
+// This kernel checks floating point values within a block of records
+uint64_t DB::ScanKernel::match_float(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+	unsigned int value_stride, float low, float high, bool vectorized)
+{
+#ifdef SCAN_KERNEL_AVX2
+	if (vectorized && has_avx2())
+		return match_float_avx2(ids, values, count, id_stride, value_stride, low, high);
+#endif
+
+	return match_float_scalar(ids, values, count, id_stride, value_stride, low, high);
+}
+
+/* This kernel checks 16 character string values within a block of records
+* Strings are compared byte by byte as they are stored on disk, padded with spaces
+*/
+uint64_t DB::ScanKernel::match_char16(const char* ids, const char* values, unsigned int count, unsigned int id_stride,
+	unsigned int value_stride, const char* low, const char* high)
+{
+	const size_t CHAR_16_SIZE = 16;
+
+	uint64_t bitmap = 0;
+	for (unsigned int i = 0; i < count; i++, ids += id_stride, values += value_stride)
+	{
+		unsigned int id;
+		memcpy(&id, ids, sizeof(unsigned int));
+
+		if (id != 0 && memcmp(values, low, CHAR_16_SIZE) >= 0 && memcmp(values, high, CHAR_16_SIZE) <= 0)
+			bitmap |= (uint64_t) 1 << i;
+	}
+
+	return bitmap;
+}
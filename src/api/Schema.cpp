@@ -0,0 +1,84 @@
+/* This file contains function definitions for the Schema class
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+
+/* This constructor compiles the record layout of a table
+* Fields are laid out like version 2 and later records, with the id first followed by the table fields in table order
+*/
+DB::Schema::Schema(DB::Table table) : table(table)
+{
+	const std::map<std::string, Field>& table_fields = this -> table.get_fields();
+	int sizes[] = { (int) AttrInt().get_size(), (int) AttrFloat().get_size(), (int) AttrChar16().get_size() };
+
+	std::string id_name = FixedString8("id").get();
+	field_indexes[id_name] = 0;
+	fields.push_back(FieldHandle(id_name, ATTR_ID, 0, 0, AttrID().get_size()));
+	record_size = AttrID().get_size();
+
+	std::map<std::string, Field>::const_iterator it;
+	for (it = table_fields.begin(); it != table_fields.end(); it++)
+	{
+		int type = it -> second.get_type();
+		if (type == ATTR_ID)
+			continue;
+
+		field_indexes[it -> first] = fields.size();
+		fields.push_back(FieldHandle(it -> first, type, fields.size(), record_size, sizes[type]));
+		record_size += sizes[type];
+	}
+}
+
+// This function returns the handle of a field by name, which isn't valid if the table has no such field
+DB::FieldHandle DB::Schema::get_field(std::string name) const
+{
+	FixedString8 fixed_name(name);
+	std::map<std::string, unsigned int>::const_iterator it = field_indexes.find(fixed_name.get());
+	if (it == field_indexes.end())
+		return FieldHandle();
+
+	return fields[it -> second];
+}
+
+// This getter returns the handles of every field in record order, starting with the id
+const std::vector<DB::FieldHandle>& DB::Schema::get_fields() const
+{
+	return fields;
+}
+
+/* This function returns whether a handle is for a field of this schema, without looking its name up
+* Handles from another schema with the same field in the same place also match
+*/
+bool DB::Schema::has_field(const DB::FieldHandle& field) const
+{
+	return field.is_valid() && field.get_index() < fields.size() && fields[field.get_index()].matches(field);
+}
+
+// This getter returns the size of a serialized record in bytes
+unsigned int DB::Schema::get_record_size() const
+{
+	return record_size;
+}
+
+// This getter returns a copy of the table the schema was compiled from
+DB::Table DB::Schema::get_table() const
+{
+	return table;
+}
+
+// This function returns whether another schema lays out the same fields in the same places
+bool DB::Schema::matches(const DB::Schema& schema) const
+{
+	if (fields.size() != schema.fields.size())
+		return false;
+
+	for (size_t i = 0; i < fields.size(); i++)
+	{
+		if (fields[i].get_name() != schema.fields[i].get_name() || fields[i].get_type() != schema.fields[i].get_type())
+			return false;
+	}
+
+	return true;
+}
@@ -8,7 +8,7 @@
 #include <DB.h>
 
 // This function writes table information to disk using a stream object
-void DB::Table::write(std::fstream& stream)
+void DB::Table::write(std::ostream& stream)
 {	
 	// Make sure the table isn't empty before writing
 	if (fields.empty())
@@ -38,7 +38,7 @@ void DB::Table::write(std::fstream& stream)
 }
 
 // This function reads table information from disk using a stream object
-void DB::Table::read(std::fstream& stream)
+void DB::Table::read(std::istream& stream)
 {	
 	// Read in the field size and number of fields from disk
 	int num_fields;
@@ -64,12 +64,20 @@ void DB::Table::add_field(std::string name, int type)
 	fields[new_field.get_name().get()] = new_field;
 }
 
-// This function returns a copy of the table fields
-std::map<std::string, DB::Field> DB::Table::get_fields()
+// This function returns the table fields
+const std::map<std::string, DB::Field>& DB::Table::get_fields() const
 {
 	return fields;
 }
 
+/* This function compiles the table in to a schema with the layout of its records
+* The schema can't be changed, so it can be shared by every record built on it
+*/
+std::shared_ptr<const DB::Schema> DB::Table::compile() const
+{
+	return std::make_shared<const Schema>(*this);
+}
+
 // This function returns whether or not a field is in the table
 bool DB::Table::is_field(std::string name)
 {
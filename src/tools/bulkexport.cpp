@@ -0,0 +1,175 @@
+/* This file contains a tool that exports the records of a PowderBase database to CSV, JSON Lines or binary
+* This file contains the main entry point for the program
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+
+/* This function builds a predicate from a comparison such as Squat>=200 or Name=Josh
+* The value is read with the type of the field. Returns false if the comparison can't be used
+*/
+bool parse_predicate(std::string comparison, std::shared_ptr<const DB::Schema> schema, DB::Predicate& predicate)
+{
+	size_t op_start = comparison.find_first_of("<>=");
+	if (op_start == std::string::npos || op_start == 0)
+		return false;
+
+	size_t value_start = op_start + 1;
+	if (value_start < comparison.size() && comparison[value_start] == '=' && comparison[op_start] != '=')
+		value_start++;
+
+	std::string op_text = comparison.substr(op_start, value_start - op_start);
+	std::string value = comparison.substr(value_start);
+	int op = DB::OP_EQ;
+	if (op_text == "<")
+		op = DB::OP_LT;
+	else if (op_text == "<=")
+		op = DB::OP_LE;
+	else if (op_text == ">")
+		op = DB::OP_GT;
+	else if (op_text == ">=")
+		op = DB::OP_GE;
+
+	DB::FieldHandle field = schema -> get_field(comparison.substr(0, op_start));
+	std::stringstream ss(value);
+	if (field.get_type() == DB::ATTR_INT)
+	{
+		int data;
+		if (! (ss >> data))
+			return false;
+		predicate.set_int(field, op, data);
+	}
+	else if (field.get_type() == DB::ATTR_FLOAT)
+	{
+		float data;
+		if (! (ss >> data))
+			return false;
+		predicate.set_float(field, op, data);
+	}
+	else if (field.get_type() == DB::ATTR_CHAR16)
+	{
+		predicate.set_char16(field, op, value);
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// This function prints the usage message and exits
+void usage()
+{
+	std::cerr << "Usage bulkexport [required: -d/--db <database name>] [optional: -o/--output <output file, default standard output>]\n"
+		<< "\t[optional: -f/--format <csv, json or binary>] [optional: -s/--select <Name,Squat> <fields to export after the id>]\n"
+		<< "\t[optional: -w/--where <Squat>=200> <export only the records matching a comparison>]\n";
+	exit(EXIT_FAILURE);
+}
+
+/* This function is the main entry point for the program
+* Records are streamed from the database in file order and written in large buffered writes
+* The export rate is reported on standard error so it doesn't mix with records written to standard output
+*/
+int main(int argc, char* argv[])
+{
+	// Get command line arguments
+	std::string db_name;
+	std::string output_name;
+	std::string format_name = "csv";
+	std::string select;
+	std::string where;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i] == std::string("-d") || argv[i] == std::string("--db")) && i + 1 < argc)
+			db_name = argv[++i];
+		else if ((argv[i] == std::string("-o") || argv[i] == std::string("--output")) && i + 1 < argc)
+			output_name = argv[++i];
+		else if ((argv[i] == std::string("-f") || argv[i] == std::string("--format")) && i + 1 < argc)
+			format_name = argv[++i];
+		else if ((argv[i] == std::string("-s") || argv[i] == std::string("--select")) && i + 1 < argc)
+			select = argv[++i];
+		else if ((argv[i] == std::string("-w") || argv[i] == std::string("--where")) && i + 1 < argc)
+			where = argv[++i];
+		else
+			usage();
+	}
+
+	if (db_name == "")
+		usage();
+
+	int format = DB::EXPORT_CSV;
+	if (format_name == "json")
+		format = DB::EXPORT_JSON;
+	else if (format_name == "binary")
+		format = DB::EXPORT_BINARY;
+	else if (format_name != "csv")
+		usage();
+
+	std::vector<std::string> fields;
+	std::stringstream select_stream(select);
+	std::string field;
+	while (std::getline(select_stream, field, ','))
+		fields.push_back(field);
+
+	// Load the database and build the predicate on its fields
+	DB db;
+	db.load(db_name);
+	std::shared_ptr<const DB::Schema> schema = db.get_schema();
+	if (! schema)
+	{
+		std::cerr << "Unable to open database " << db_name << "\n";
+		exit(EXIT_FAILURE);
+	}
+
+	DB::Predicate predicate;
+	predicate.set_all();
+	if (where != "" && ! parse_predicate(where, schema, predicate))
+	{
+		std::cerr << "Unable to use comparison " << where << "\n";
+		exit(EXIT_FAILURE);
+	}
+
+	// Open the output file, or write to standard output
+	std::ofstream output_file;
+	if (output_name != "")
+	{
+		output_file.open(output_name.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+		if (! output_file.is_open())
+		{
+			std::cerr << "Unable to open output file " << output_name << "\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	std::ostream& output = output_name != "" ? output_file : std::cout;
+
+	// Export the records and report the rate
+	auto start = std::chrono::high_resolution_clock::now();
+	unsigned int count = db.export_records(output, format, predicate, fields);
+	auto end = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000000.0;
+	if (seconds <= 0)
+		seconds = 0.000001;
+
+	if (! output)
+	{
+		std::cerr << "Unable to write the export\n";
+		exit(EXIT_FAILURE);
+	}
+
+	std::cerr << "Exported " << count << " records in " << seconds << " s: " << (size_t) (count / seconds) << " records/sec";
+	if (output_name != "")
+		std::cerr << ", " << output_file.tellp() / seconds / (1024 * 1024) << " MB/s";
+	std::cerr << "\n";
+
+	db.close();
+	return 0;
+}
@@ -0,0 +1,418 @@
+/* This file contains a tool that loads the rows of a CSV or TSV file in to a PowderBase database
+* This file contains the main entry point for the program
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+
+/* This class reads the rows of a CSV or TSV file through a large buffer
+* CSV fields can be quoted, with doubled quotes inside quoted fields, and quoted fields can span lines
+* TSV fields are taken as they are. Blank lines are skipped and line endings can be LF or CRLF
+* Lines are counted as they are read, so problems can be reported with the line each row starts on
+*/
+class RowReader
+{
+	// This block defines variables for buffering the file
+	private:
+		static const size_t BUFFER_SIZE = 1024 * 1024;
+
+		std::ifstream file;
+		std::vector<char> buffer;
+		size_t position;
+		size_t size;
+		size_t bytes;
+		size_t line;
+		size_t row_line;
+		char delimiter;
+
+		// This function returns the next character of the file, or EOF at the end of the file
+		int next_char()
+		{
+			if (position == size)
+			{
+				file.read(&buffer[0], buffer.size());
+				size = file.gcount();
+				position = 0;
+				bytes += size;
+				if (size == 0)
+					return EOF;
+			}
+
+			if (buffer[position] == '\n')
+				line++;
+
+			return (unsigned char) buffer[position++];
+		}
+
+	// This block defines functions for reading rows
+	public:
+		RowReader() : buffer(BUFFER_SIZE), position(0), size(0), bytes(0), line(0), row_line(0), delimiter(',')
+		{
+		}
+
+		// This function opens the file, and fields are split on the given delimiter
+		bool open(std::string filename, char delimiter)
+		{
+			this -> delimiter = delimiter;
+			file.open(filename.c_str(), std::ios::in | std::ios::binary);
+			return file.is_open();
+		}
+
+		/* This function reads the fields of the next row, reusing the strings of the previous row
+		* Returns false at the end of the file
+		*/
+		bool read_row(std::vector<std::string>& fields, size_t& count)
+		{
+			count = 0;
+			int c = next_char();
+			while (c == '\r' || c == '\n')
+				c = next_char();
+
+			if (c == EOF)
+				return false;
+
+			row_line = line + 1;
+
+			while (true)
+			{
+				if (count == fields.size())
+					fields.push_back(std::string());
+
+				std::string& field = fields[count++];
+				field.clear();
+
+				// Read a quoted CSV field up to its closing quote, then anything before the next delimiter
+				if (c == '"' && delimiter != '\t')
+				{
+					c = next_char();
+					while (c != EOF)
+					{
+						if (c == '"')
+						{
+							c = next_char();
+							if (c != '"')
+								break;
+						}
+
+						field += (char) c;
+						c = next_char();
+					}
+				}
+
+				while (c != EOF && c != delimiter && c != '\n')
+				{
+					if (c != '\r')
+						field += (char) c;
+
+					// Append the rest of the field that is already in the buffer at once
+					size_t begin = position;
+					while (position < size && buffer[position] != delimiter && buffer[position] != '\n' && buffer[position] != '\r')
+						position++;
+					field.append(&buffer[begin], position - begin);
+
+					c = next_char();
+				}
+
+				if (c != delimiter)
+					return true;
+
+				c = next_char();
+			}
+		}
+
+		// This getter returns the number of bytes read from the file
+		size_t get_bytes()
+		{
+			return bytes;
+		}
+
+		// This getter returns the line of the file the last row read starts on, counting from 1
+		size_t get_row_line()
+		{
+			return row_line;
+		}
+};
+
+/* This function builds a table from a list of fields such as Name:char16,Squat:int,Wilks:float
+* Returns false if a field doesn't have a known type
+*/
+bool parse_table(std::string fields, DB::Table& table)
+{
+	std::stringstream ss(fields);
+	std::string field;
+	while (std::getline(ss, field, ','))
+	{
+		size_t separator = field.find(':');
+		if (separator == std::string::npos)
+			return false;
+
+		std::string name = field.substr(0, separator);
+		std::string type = field.substr(separator + 1);
+		if (type == "int")
+			table.add_field(name, DB::ATTR_INT);
+		else if (type == "float")
+			table.add_field(name, DB::ATTR_FLOAT);
+		else if (type == "char16")
+			table.add_field(name, DB::ATTR_CHAR16);
+		else
+			return false;
+	}
+
+	return true;
+}
+
+/* This function reads an int value from a cell
+* Returns false unless the whole cell, apart from surrounding spaces, is a number that fits in an int
+*/
+bool parse_int(const std::string& value, int& data)
+{
+	char* end = NULL;
+	errno = 0;
+	long result = strtol(value.c_str(), &end, 10);
+	if (end == value.c_str() || errno == ERANGE || result < INT_MIN || result > INT_MAX)
+		return false;
+
+	while (*end == ' ')
+		end++;
+
+	data = (int) result;
+	return *end == '\0';
+}
+
+/* This function reads a float value from a cell
+* Returns false unless the whole cell, apart from surrounding spaces, is a number in the range of a float
+*/
+bool parse_float(const std::string& value, float& data)
+{
+	char* end = NULL;
+	errno = 0;
+	data = strtof(value.c_str(), &end);
+	if (end == value.c_str() || errno == ERANGE)
+		return false;
+
+	while (*end == ' ')
+		end++;
+
+	return *end == '\0';
+}
+
+// This function prints the usage message and exits
+void usage()
+{
+	std::cout << "Usage bulkload [required: -i/--input <csv or tsv file>] [required: -d/--db <database name>]\n"
+		<< "\t[optional: -t/--table <Name:char16,Squat:int,Wilks:float> <create the database with the table>]\n"
+		<< "\t[optional: -x/--index <field> <build an index on the field after loading, can be repeated>]\n"
+		<< "\t[optional: -b/--batch <rows per batch>] [optional: --tsv <tab separated input>]\n";
+	exit(EXIT_FAILURE);
+}
+
+/* This function is the main entry point for the program
+* The header row of the input names the table field of each column. Columns that aren't fields and the id column
+* are skipped, and fields without a column keep their default values. Record ids are assigned in row order
+* Rows are built as flat records and inserted in large batches, so each batch is written to the file in one write
+* Rows with an int or float cell that isn't a whole number in range, including an empty one, are skipped and reported
+* with their line, and the tool then exits with a failure status
+*/
+int main(int argc, char* argv[])
+{
+	// Get command line arguments
+	std::string input_name;
+	std::string db_name;
+	std::string table_fields;
+	std::vector<std::string> index_fields;
+	size_t batch_rows = 65536;
+	bool tsv = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i] == std::string("-i") || argv[i] == std::string("--input")) && i + 1 < argc)
+		{
+			input_name = argv[++i];
+		}
+		else if ((argv[i] == std::string("-d") || argv[i] == std::string("--db")) && i + 1 < argc)
+		{
+			db_name = argv[++i];
+		}
+		else if ((argv[i] == std::string("-t") || argv[i] == std::string("--table")) && i + 1 < argc)
+		{
+			table_fields = argv[++i];
+		}
+		else if ((argv[i] == std::string("-x") || argv[i] == std::string("--index")) && i + 1 < argc)
+		{
+			index_fields.push_back(argv[++i]);
+		}
+		else if ((argv[i] == std::string("-b") || argv[i] == std::string("--batch")) && i + 1 < argc)
+		{
+			std::stringstream ss(argv[++i]);
+			if (! (ss >> batch_rows) || batch_rows == 0)
+				usage();
+		}
+		else if (argv[i] == std::string("--tsv"))
+		{
+			tsv = true;
+		}
+		else
+		{
+			usage();
+		}
+	}
+
+	if (input_name == "" || db_name == "")
+		usage();
+
+	if (input_name.size() >= 4 && input_name.substr(input_name.size() - 4) == ".tsv")
+		tsv = true;
+
+	// Create the database with the given table, or load it to append to its records
+	DB db;
+	if (table_fields != "")
+	{
+		DB::Table table;
+		if (! parse_table(table_fields, table))
+			usage();
+
+		db.create(db_name, table);
+	}
+	else
+	{
+		db.load(db_name);
+	}
+
+	std::shared_ptr<const DB::Schema> schema = db.get_schema();
+	if (! schema)
+	{
+		std::cout << "Unable to open database " << db_name << "\n";
+		exit(EXIT_FAILURE);
+	}
+
+	// Read the header row and look up the field of each column once
+	RowReader reader;
+	if (! reader.open(input_name, tsv ? '\t' : ','))
+	{
+		std::cout << "Unable to open input file " << input_name << "\n";
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<std::string> values;
+	size_t count = 0;
+	if (! reader.read_row(values, count))
+	{
+		std::cout << "Input file " << input_name << " has no header row\n";
+		exit(EXIT_FAILURE);
+	}
+
+	if (count > 0 && values[0].compare(0, 3, "\xEF\xBB\xBF") == 0)
+		values[0].erase(0, 3);
+
+	std::vector<DB::FieldHandle> columns;
+	std::vector<std::string> column_names(values.begin(), values.begin() + count);
+	for (size_t i = 0; i < count; i++)
+	{
+		DB::FieldHandle field = schema -> get_field(values[i]);
+		if (field.is_valid() && field.get_type() != DB::ATTR_INT && field.get_type() != DB::ATTR_FLOAT
+			&& field.get_type() != DB::ATTR_CHAR16)
+			field = DB::FieldHandle();
+
+		if (! field.is_valid())
+			std::cout << "Skipping column " << values[i] << "\n";
+
+		columns.push_back(field);
+	}
+
+	/* Build each row as a flat record and insert the records a batch at a time
+	* The records of a batch are reset from an empty record, which reuses their value buffers
+	*/
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const DB::FlatRecord empty_record(schema);
+	std::vector<DB::FlatRecord> batch(batch_rows, empty_record);
+	size_t batch_count = 0;
+	size_t rows = 0;
+	size_t skipped = 0;
+	while (reader.read_row(values, count))
+	{
+		DB::FlatRecord& record = batch[batch_count++];
+		record = empty_record;
+
+		bool valid = true;
+		for (size_t i = 0; i < count && i < columns.size() && valid; i++)
+		{
+			const DB::FieldHandle& field = columns[i];
+			if (! field.is_valid())
+				continue;
+
+			int int_data = 0;
+			float float_data = 0;
+			if (field.get_type() == DB::ATTR_INT && parse_int(values[i], int_data))
+				record.set_int(field, int_data);
+			else if (field.get_type() == DB::ATTR_FLOAT && parse_float(values[i], float_data))
+				record.set_float(field, float_data);
+			else if (field.get_type() == DB::ATTR_CHAR16 && ! values[i].empty())
+				record.set_char16(field, values[i]);
+			else if (field.get_type() != DB::ATTR_CHAR16)
+				valid = false;
+
+			if (! valid)
+			{
+				std::cout << "Skipping row on line " << reader.get_row_line() << ": column " << column_names[i] << " has value \""
+					<< values[i] << "\", which isn't " << (field.get_type() == DB::ATTR_INT ? "an int" : "a float") << " in range\n";
+			}
+		}
+
+		if (! valid)
+		{
+			batch_count--;
+			skipped++;
+			continue;
+		}
+
+		if (batch_count == batch_rows)
+		{
+			db.insert_batch(batch);
+			rows += batch_count;
+			batch_count = 0;
+		}
+	}
+
+	batch.resize(batch_count, empty_record);
+	db.insert_batch(batch);
+	rows += batch_count;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000000.0;
+
+	// Build any requested indexes over the loaded records
+	start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < index_fields.size(); i++)
+		db.create_index(index_fields[i]);
+	end = std::chrono::high_resolution_clock::now();
+	auto index_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+	db.close();
+
+	// Report the load rate
+	if (seconds <= 0)
+		seconds = 0.000001;
+
+	std::cout << "Loaded " << rows << " rows in " << seconds << " s: " << (size_t) (rows / seconds) << " rows/sec, "
+		<< reader.get_bytes() / seconds / (1024 * 1024) << " MB/s\n";
+
+	if (! index_fields.empty())
+		std::cout << "Index build: " << index_duration << " ms\n";
+
+	if (skipped > 0)
+	{
+		std::cout << "Skipped " << skipped << " rows with values that couldn't be loaded\n";
+		return EXIT_FAILURE;
+	}
+
+	return 0;
+}
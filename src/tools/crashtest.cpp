@@ -0,0 +1,264 @@
+/* This file contains a fault injection tool that kills a PowderBase process after inserts and at every step of a compaction
+* This file contains the main entry point for the program
+* Processes are forked and killed with SIGKILL, so the tool runs on POSIX systems
+*
+* Author: Josh McIntyre
+*/
+
+#include <DB.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+// This constant stands for the step after every record was inserted one at a time, before any compaction
+const int INSERTED_STEP = -1;
+
+// This function returns the name of a step for reporting
+std::string get_step_name(int step)
+{
+	if (step == INSERTED_STEP)
+		return "records inserted";
+	else if (step == DB::COMPACTION_WRITTEN)
+		return "temporary file written";
+	else if (step == DB::COMPACTION_SYNCED)
+		return "temporary file synced";
+	else if (step == DB::COMPACTION_RENAMED)
+		return "temporary file renamed";
+
+	return "directory synced";
+}
+
+// This function builds the record stored with an id, so the records can be checked after a crash
+DB::Record build_record(const DB::Table& table, unsigned int id)
+{
+	std::stringstream name;
+	name << "Lifter" << id;
+
+	DB::Record record;
+	record.set_table(table);
+	record.add_char16("Name", name.str());
+	record.add_int("Squat", id * 3);
+	record.add_float("Wilks", id / 2.0f);
+	return record;
+}
+
+// This function removes the database file and every side file left by an earlier run
+void remove_files(std::string db_name)
+{
+	std::string db_filename = db_name + DB_EXT;
+	std::remove(db_filename.c_str());
+	std::remove((db_filename + TEMP_EXT).c_str());
+	std::remove((db_filename + IDS_EXT).c_str());
+	std::remove((db_filename + LOCK_EXT).c_str());
+	std::remove((db_filename + LOG_EXT).c_str());
+	std::remove((db_filename + CHANGES_EXT).c_str());
+}
+
+/* This function runs in the child process for the inserted step
+* It inserts every record with a separate insert and kills the process with SIGKILL without closing the database,
+* so only what each operation wrote out before it returned is left
+*/
+void run_insert_child(std::string db_name, const DB::Table& table, bool write_log, unsigned int count)
+{
+	DB db;
+	db.set_write_log(write_log);
+	db.load(db_name);
+
+	for (unsigned int id = 1; id <= count; id++)
+		db.insert(build_record(table, id));
+
+	kill(getpid(), SIGKILL);
+	_exit(EXIT_FAILURE);
+}
+
+/* This function runs in the child process for a compaction step
+* It removes every record with an even id and compacts the database, and the compaction hook kills the process
+* with SIGKILL after the given step, so nothing is written out or closed after that point
+*/
+void run_child(std::string db_name, bool write_log, int step)
+{
+	DB db;
+	db.set_write_log(write_log);
+	db.load(db_name);
+
+	DB::Predicate predicate;
+	predicate.set_all();
+	std::vector<DB::Record> records = db.search(predicate);
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (records[i].get_id() % 2 == 0)
+			db.remove(records[i].get_id());
+	}
+
+	db.set_compaction_hook([step](int current_step)
+	{
+		if (current_step == step)
+			kill(getpid(), SIGKILL);
+	});
+
+	db.compact_now();
+	db.wait_for_compaction();
+	_exit(EXIT_FAILURE);
+}
+
+/* This function loads the database after the child was killed and checks every record
+* Every record must be there with its values, except that no record with an even id may be left if they were removed
+* The database is then compacted again to check that it can still be rewritten
+* Returns the number of records found that are correct, or -1 if the database is damaged
+*/
+int verify(std::string db_name, const DB::Table& table, unsigned int count, bool removed_even)
+{
+	DB db;
+	db.load(db_name);
+	if (! db.get_schema())
+		return -1;
+
+	std::ifstream temp_file((db_name + DB_EXT + TEMP_EXT).c_str());
+	if (temp_file.is_open())
+		return -1;
+
+	DB::Predicate predicate;
+	predicate.set_all();
+	std::vector<DB::Record> records = db.search(predicate);
+	std::vector<bool> found(count + 1, false);
+	int correct = 0;
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		unsigned int id = records[i].get_id();
+		if (id == 0 || id > count || (removed_even && id % 2 == 0) || found[id])
+			return -1;
+
+		DB::Record expected = build_record(table, id);
+		if (records[i].get_char16("Name") != expected.get_char16("Name") || records[i].get_int("Squat") != expected.get_int("Squat")
+			|| records[i].get_float("Wilks") != expected.get_float("Wilks"))
+			return -1;
+
+		found[id] = true;
+		correct++;
+	}
+
+	db.compact_now();
+	db.wait_for_compaction();
+	if (db.search(predicate).size() != records.size())
+		return -1;
+
+	db.close();
+	return correct;
+}
+
+// This function prints the usage message and exits
+void usage()
+{
+	std::cout << "Usage crashtest [optional: -d/--db <database name, default crashtest>] [optional: -r/--records <record count>]\n"
+		<< "\t[optional: -l/--log <use the write-ahead log>]\n";
+	exit(EXIT_FAILURE);
+}
+
+/* This function is the main entry point for the program
+* A child process first inserts records one at a time in to a fresh database and is killed before closing it
+* Then for each step of replacing the database file during a compaction, a fresh database is created and a child process
+* removes half of its records and compacts it, and is killed right after the step. The database is then loaded
+* and checked, which must find every remaining record no matter where the child stopped
+*/
+int main(int argc, char* argv[])
+{
+	// Get command line arguments
+	std::string db_name = "crashtest";
+	unsigned int count = 10000;
+	bool write_log = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((argv[i] == std::string("-d") || argv[i] == std::string("--db")) && i + 1 < argc)
+		{
+			db_name = argv[++i];
+		}
+		else if ((argv[i] == std::string("-r") || argv[i] == std::string("--records")) && i + 1 < argc)
+		{
+			std::stringstream ss(argv[++i]);
+			if (! (ss >> count) || count == 0)
+				usage();
+		}
+		else if (argv[i] == std::string("-l") || argv[i] == std::string("--log"))
+		{
+			write_log = true;
+		}
+		else
+		{
+			usage();
+		}
+	}
+
+	DB::Table table;
+	table.add_field("Name", DB::ATTR_CHAR16);
+	table.add_field("Squat", DB::ATTR_INT);
+	table.add_field("Wilks", DB::ATTR_FLOAT);
+
+	bool failed = false;
+	int steps[] = { INSERTED_STEP, DB::COMPACTION_WRITTEN, DB::COMPACTION_SYNCED, DB::COMPACTION_RENAMED,
+		DB::COMPACTION_DIRECTORY_SYNCED };
+	for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+	{
+		// Create a fresh database, with the records for a compaction step or empty for the inserted step
+		bool inserted = steps[i] == INSERTED_STEP;
+		remove_files(db_name);
+		{
+			DB db;
+			db.create(db_name, table);
+
+			std::vector<DB::Record> records;
+			for (unsigned int id = 1; id <= count && ! inserted; id++)
+				records.push_back(build_record(table, id));
+			db.insert_batch(records);
+			db.close();
+		}
+
+		// Insert or compact in a child process that is killed after the step
+		std::cout.flush();
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			std::cout << "Unable to start a child process\n";
+			exit(EXIT_FAILURE);
+		}
+
+		if (pid == 0 && inserted)
+			run_insert_child(db_name, table, write_log, count);
+		else if (pid == 0)
+			run_child(db_name, write_log, steps[i]);
+
+		int status = 0;
+		waitpid(pid, &status, 0);
+		if (! WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL)
+		{
+			std::cout << "Killed after " << get_step_name(steps[i]) << ": the child wasn't killed at the step\n";
+			failed = true;
+			continue;
+		}
+
+		// Load the database the child left behind and check it
+		unsigned int expected = inserted ? count : (count + 1) / 2;
+		int correct = verify(db_name, table, count, ! inserted);
+		if (correct < 0 || (unsigned int) correct != expected)
+		{
+			std::cout << "Killed after " << get_step_name(steps[i]) << ": FAILED, ";
+			if (correct < 0)
+				std::cout << "the database is damaged\n";
+			else
+				std::cout << correct << " of " << expected << " records found\n";
+			failed = true;
+			continue;
+		}
+
+		std::cout << "Killed after " << get_step_name(steps[i]) << ": " << correct << " of " << expected << " records ok\n";
+	}
+
+	remove_files(db_name);
+	return failed ? EXIT_FAILURE : 0;
+}
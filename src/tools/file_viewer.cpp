@@ -14,6 +14,7 @@
 int main(int argc, char* argv[])
 {
 	// Define constants and variables for printing file information
+	const std::string MAGIC = "PBDB";
 	const int NAME_SIZE = 8;
 	const int CHAR_16_SIZE = 16;
 	std::map<int, int> type_sizes; 
@@ -58,6 +59,31 @@ int main(int argc, char* argv[])
 	// Open a stream with the database file
 	std::fstream db_file(file_name.c_str(), std::fstream::in | std::ios::binary);
 	
+	/* Read and print the file format information
+	* Version 1 files have no magic string and start directly with the table
+	*/
+	if (verbose)
+		std::cout << "Format\n";
+
+	unsigned int format = 1;
+	std::string magic;
+	magic.resize(MAGIC.size());
+	db_file.read(&magic[0], MAGIC.size());
+
+	if (db_file && magic == MAGIC)
+	{
+		db_file.read((char*)&format, sizeof(unsigned int));
+	}
+	else
+	{
+		db_file.clear();
+		db_file.seekg(0);
+	}
+
+	if (verbose)
+		std::cout << " (byte " << db_file.tellg() << ") ";
+	std::cout << format << "\n";
+
 	// Read and print the table information
 	if (verbose)
 		std::cout << "Table\n";
@@ -118,16 +144,132 @@ int main(int argc, char* argv[])
 	db_file.read((char*)&record_size, sizeof(int));
 	std::cout << record_size << "\n";
 
-	for(int i = 0; i < record_count; i++)
+	/* Version 3 headers also store the live count, removed count, next id, header state and checksum
+	* Version 4 headers add the layout and row group size before the checksum
+	* Version 5 headers add the generation before the checksum
+	* A header state of 1 means the file is open or wasn't closed cleanly, and a layout of 1 means columnar
+	*/
+	int header_values = 0;
+	if (format == 3)
+		header_values = 5;
+	else if (format == 4)
+		header_values = 7;
+	else if (format >= 5)
+		header_values = 8;
+
+	unsigned int layout = 0;
+	unsigned int group_rows = 0;
+	for (int i = 0; i < header_values; i++)
 	{
-		for (int c = 0; c < num_fields; c++)
-		{
+		if (verbose)
+			std::cout << " (byte " << db_file.tellg() << ") ";
+		unsigned int value;
+		db_file.read((char*)&value, sizeof(unsigned int));
+		std::cout << value << "\n";
 
+		if (i == 4 && format >= 4)
+			layout = value;
+		if (i == 5 && format >= 4)
+			group_rows = value;
+	}
+
+	/* Columnar records are stored in row groups, with the values of each field stored together in record order
+	* Print each row group field by field, including the unused slots of the last group
+	*/
+	if (layout == 1 && group_rows > 0)
+	{
+		for (unsigned int group = 0; group * group_rows < record_count; group++)
+		{
 			if (verbose)
-				std::cout << " (byte " << db_file.tellg() << ") ";
+				std::cout << "Group " << group << "\n";
+
+			std::map<std::string, int>::iterator it = name_types.begin();
+			bool id_read = false;
+
+			for (int c = 0; c < num_fields; c++)
+			{
+				std::string name;
+				if (! id_read)
+				{
+					name = "id      ";
+					id_read = true;
+				}
+				else
+				{
+					if (it -> second == -1)
+						it++;
+					name = it -> first;
+					it++;
+				}
+				std::cout << name << "\n";
+
+				int type = name_types[name];
+				for (unsigned int row = 0; row < group_rows; row++)
+				{
+					if (verbose)
+						std::cout << " (byte " << db_file.tellg() << ") ";
+
+					if (type == -1)
+					{
+						unsigned int id;
+						db_file.read((char*)&id, sizeof(unsigned int));
+						std::cout << id << "\n";
+					}
+					else if (type == 0) //AttrInt
+					{
+						int data;
+						db_file.read((char*)&data, sizeof(int));
+						std::cout << data << "\n";
+					}
+					else if (type == 1) //AttrFloat
+					{
+						float data;
+						db_file.read((char*)&data, sizeof(float));
+						std::cout << data << "\n";
+					}
+					else if (type == 2) //AttrChar16
+					{
+						std::string data;
+						data.resize(CHAR_16_SIZE);
+						db_file.read(&data[0], CHAR_16_SIZE);
+						std::cout << data << "\n";
+					}
+				}
+			}
+		}
+	}
+
+	for(int i = 0; layout != 1 && i < record_count; i++)
+	{
+		/* Version 2 and later records don't store field names, so take them from the table in record order
+		* The id comes first, followed by the remaining fields in table order
+		*/
+		std::map<std::string, int>::iterator it = name_types.begin();
+		bool id_read = false;
+
+		for (int c = 0; c < num_fields; c++)
+		{
 			std::string name;
-			name.resize(NAME_SIZE);
-			db_file.read(&name[0], NAME_SIZE);
+
+			if (format == 1)
+			{
+				if (verbose)
+					std::cout << " (byte " << db_file.tellg() << ") ";
+				name.resize(NAME_SIZE);
+				db_file.read(&name[0], NAME_SIZE);
+			}
+			else if (! id_read)
+			{
+				name = "id      ";
+				id_read = true;
+			}
+			else
+			{
+				if (it -> second == -1)
+					it++;
+				name = it -> first;
+				it++;
+			}
 			std::cout << name << "\n";
 
 			// Determine how much to read based on the field type in the table
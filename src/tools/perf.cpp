@@ -9,6 +9,36 @@
 #include <sstream>
 #include <chrono>
 #include <cstdlib>
+#include <new>
+#include <atomic>
+
+/* Count the heap allocations made by the program so the allocations made by each search can be reported
+* Array allocations and sized deletes go through these functions by default
+*/
+std::atomic<size_t> allocation_count(0);
+
+void* operator new(size_t size)
+{
+	allocation_count++;
+	void* data = malloc(size == 0 ? 1 : size);
+	if (data == NULL)
+		throw std::bad_alloc();
+
+	return data;
+}
+
+void operator delete(void* data) noexcept
+{
+	free(data);
+}
+
+// This function returns a distinct lifter name for each record so Name searches are selective
+std::string lifter_name(int i)
+{
+	std::stringstream ss;
+	ss << "Lifter " << i;
+	return ss.str();
+}
 
 // This function is the main entry point for the program
 int main(int argc, char* argv[])
@@ -65,7 +95,7 @@ int main(int argc, char* argv[])
 	{
 		DB::Record record;
 		record.set_table(table);
-		record.add_char16("Name", "Josh");
+		record.add_char16("Name", lifter_name(i));
 		record.add_int("Squat", 245);
 		record.add_int("Press", 105);
 		db.insert(record);
@@ -75,6 +105,89 @@ int main(int argc, char* argv[])
 	
 	std::cout << "Insert: " << duration << " ms\n";
 	
+	// Test batched record creation in a separate database
+	DB db_batch;
+	db_batch.create("perf_batch", table);
+	start = std::chrono::high_resolution_clock::now();
+	std::vector<DB::Record> batch;
+	for (int i = 0; i < num_records; i++)
+	{
+		DB::Record record;
+		record.set_table(table);
+		record.add_char16("Name", lifter_name(i));
+		record.add_int("Squat", 245);
+		record.add_int("Press", 105);
+		batch.push_back(record);
+	}
+	db_batch.insert_batch(batch);
+	end = std::chrono::high_resolution_clock::now();
+	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	
+	std::cout << "Batch insert: " << duration << " ms\n";
+
+	// Test batched creation of flat records, which are built in place on the compiled schema
+	DB db_flat;
+	db_flat.create("perf_flat", table);
+	std::shared_ptr<const DB::Schema> schema = db_flat.get_schema();
+	DB::FieldHandle name_field = schema -> get_field("Name");
+	DB::FieldHandle squat_field = schema -> get_field("Squat");
+	DB::FieldHandle press_field = schema -> get_field("Press");
+	start = std::chrono::high_resolution_clock::now();
+	std::vector<DB::FlatRecord> flat_batch;
+	flat_batch.reserve(num_records);
+	for (int i = 0; i < num_records; i++)
+	{
+		DB::FlatRecord record(schema);
+		record.set_char16(name_field, lifter_name(i));
+		record.set_int(squat_field, 245);
+		record.set_int(press_field, 105);
+		flat_batch.push_back(record);
+	}
+	db_flat.insert_batch(flat_batch);
+	end = std::chrono::high_resolution_clock::now();
+	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+	std::cout << "Batch insert (flat records): " << duration << " ms\n";
+
+	// Test record creation in a database shared with other processes, which locks the file around every insert
+	DB db_shared;
+	db_shared.set_shared(true);
+	db_shared.create("perf_shared", table);
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < num_records; i++)
+	{
+		DB::Record record;
+		record.set_table(table);
+		record.add_char16("Name", lifter_name(i));
+		record.add_int("Squat", 245);
+		record.add_int("Press", 105);
+		db_shared.insert(record);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+	std::cout << "Insert (shared): " << duration << " ms\n";
+
+	// Test record creation in a database with a write-ahead log, which is synced once per group of inserts
+	DB db_logged;
+	db_logged.set_write_log(true);
+	db_logged.create("perf_logged", table);
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < num_records; i++)
+	{
+		DB::Record record;
+		record.set_table(table);
+		record.add_char16("Name", lifter_name(i));
+		record.add_int("Squat", 245);
+		record.add_int("Press", 105);
+		db_logged.insert(record);
+	}
+	db_logged.commit();
+	end = std::chrono::high_resolution_clock::now();
+	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+	std::cout << "Insert (write log): " << duration << " ms\n";
+	
 	// Test record update
 	start = std::chrono::high_resolution_clock::now();
 	for (int i = 0; i < num_records; i++)
@@ -82,7 +195,7 @@ int main(int argc, char* argv[])
 		DB::Record record;
 		record.set_table(table);
 		record.set_id(i + 1);
-		record.add_char16("Name", "Josh");
+		record.add_char16("Name", lifter_name(i));
 		record.add_int("Squat", 245);
 		record.add_int("Press", 105);
 		record.add_int("Deadlift", 305);
@@ -93,14 +206,122 @@ int main(int argc, char* argv[])
 	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 	
 	std::cout << "Update: " << duration << " ms\n";
+	std::cout << "Page cache: " << db.get_cache_hits() << " hits, " << db.get_cache_misses() << " misses\n";
 	
 	// Test record search
+	size_t allocations = allocation_count;
 	start = std::chrono::high_resolution_clock::now();
 	std::vector<DB::Record> records = db.search_int("Squat", 245);
 	end = std::chrono::high_resolution_clock::now();
 	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 	
-	std::cout << "Search: " << duration << " ms\n";
+	std::cout << "Search: " << duration << " ms, " << allocation_count - allocations << " allocations\n";
+
+	/* Test the same search streamed through a visitor that reads a field of each record in place
+	* The field is read through a handle, so its name isn't looked up for each record
+	*/
+	long long squat_total = 0;
+	DB::FieldHandle squat = db.get_schema() -> get_field("Squat");
+	start = std::chrono::high_resolution_clock::now();
+	DB::Predicate squat_predicate;
+	squat_predicate.set_int(squat, DB::OP_EQ, 245);
+	allocations = allocation_count;
+	db.search(squat_predicate, [&](DB::RecordView& record)
+	{
+		squat_total += record.get_int(squat);
+		return true;
+	});
+	end = std::chrono::high_resolution_clock::now();
+	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+	std::cout << "Search (streaming): " << duration << " ms, " << allocation_count - allocations << " allocations\n";
+
+	// Test the same search returning only the id and name of each record
+	std::vector<std::string> projection(1, "Name");
+	allocations = allocation_count;
+	start = std::chrono::high_resolution_clock::now();
+	std::vector<DB::Row> rows = db.search(squat_predicate, projection);
+	end = std::chrono::high_resolution_clock::now();
+	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+	std::cout << "Search (projected): " << duration << " ms, " << allocation_count - allocations << " allocations\n";
+
+	/* Test full record scans that match no records with the scalar and vectorized scan kernels
+	* Searches on an integer field and a floating point field are timed for each kernel
+	*/
+	bool vectorized_modes[] = { false, true };
+	std::string mode_names[] = { "scalar", "vectorized" };
+	for (int m = 0; m < 2; m++)
+	{
+		db.set_vectorized(vectorized_modes[m]);
+		start = std::chrono::high_resolution_clock::now();
+		db.search_int("Squat", -1);
+		db.search_float("Wilks", -1.0);
+		end = std::chrono::high_resolution_clock::now();
+		auto scan_duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+		std::cout << "Scan (" << mode_names[m] << "): " << scan_duration << " us\n";
+	}
+	db.set_vectorized(true);
+
+	/* Test the same full record scans on a columnar copy of the batched records
+	* Only the id and searched field columns of each row group are read
+	*/
+	DB db_columns;
+	db_columns.create("perf_columns", table, DB::LAYOUT_COLUMNS);
+	db_columns.insert_batch(batch);
+	start = std::chrono::high_resolution_clock::now();
+	db_columns.search_int("Squat", -1);
+	db_columns.search_float("Wilks", -1.0);
+	end = std::chrono::high_resolution_clock::now();
+	auto columns_duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+	std::cout << "Scan (columnar): " << columns_duration << " us\n";
+
+	/* Test how full record scans scale with the number of scan threads
+	* The thread count doubles from 1 up to the number of CPU cores
+	*/
+	unsigned int max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, max_threads))
+	{
+		db.set_scan_threads(threads);
+		start = std::chrono::high_resolution_clock::now();
+		db.search_int("Squat", -1);
+		db.search_float("Wilks", -1.0);
+		end = std::chrono::high_resolution_clock::now();
+		auto parallel_duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+		std::cout << "Parallel scan (" << threads << " threads): " << parallel_duration << " us\n";
+
+		if (threads == max_threads)
+			break;
+	}
+	db.set_scan_threads(0);
+
+	/* Test equality search latency on the Name field without and with a hash index
+	* The hash index is built by the first search after it is enabled
+	*/
+	int num_queries = 100;
+	start = std::chrono::high_resolution_clock::now();
+	for (int q = 0; q < num_queries; q++)
+		db.search_char16("Name", lifter_name((long long) q * num_records / num_queries));
+	end = std::chrono::high_resolution_clock::now();
+	auto query_duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / num_queries;
+
+	std::cout << "Name search (unindexed): " << query_duration << " us/query\n";
+
+	db.enable_hash_index("Name");
+	db.search_char16("Name", lifter_name(0));
+	std::cout << "Hash index build: " << db.get_hash_index_build_time("Name") << " ms, "
+		<< db.get_hash_index_memory("Name") << " bytes\n";
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int q = 0; q < num_queries; q++)
+		db.search_char16("Name", lifter_name((long long) q * num_records / num_queries));
+	end = std::chrono::high_resolution_clock::now();
+	query_duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / num_queries;
+
+	std::cout << "Name search (hash index): " << query_duration << " us/query\n";
 
 	// Test record removal
 	start = std::chrono::high_resolution_clock::now();
@@ -113,5 +334,14 @@ int main(int argc, char* argv[])
 	
 	std::cout << "Remove: " << duration << " ms\n";
 
+	// Test compacting the removed records out of the file
+	start = std::chrono::high_resolution_clock::now();
+	db.compact_now();
+	db.wait_for_compaction();
+	end = std::chrono::high_resolution_clock::now();
+	duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+	std::cout << "Compaction: " << duration << " ms\n";
+
 	return 0;
 }